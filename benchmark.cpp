@@ -0,0 +1,836 @@
+#include "benchmark.h"
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+#include "types.h"
+#include "bitboard.h"
+#include "search.h"
+#include "tt.h"
+#include "tables.h"
+#include "eval.h"
+#include "regression.h"
+#include "omp.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+
+/*
+    Hardware cache miss counter for the calling thread. Reads -1 when
+    performance counters are not available (non Linux, or not permitted).
+*/
+class CacheMisses {
+public:
+    CacheMisses() {
+#ifdef __linux__
+        perf_event_attr attr{};
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+    }
+
+    ~CacheMisses() {
+#ifdef __linux__
+        if (fd >= 0) close(fd);
+#endif
+    }
+
+    void start() {
+#ifdef __linux__
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    long long stop() {
+        long long count = -1;
+#ifdef __linux__
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(fd, &count, sizeof(count)) != sizeof(count))
+                count = -1;
+        }
+#endif
+        return count;
+    }
+
+private:
+    int fd = -1;
+};
+
+
+/*
+    Positions sampled from a single game played by the search. The generator
+    is reseeded so every benchmark run sees the same positions.
+*/
+std::vector<Bitboard> game_positions(int count, int every) {
+    std::vector<Bitboard> positions;
+
+    generator.seed(2048);
+    Bitboard board = place_random(place_random(0x0ULL));
+
+    for (int i = 0; positions.size() < (size_t)count; ++i) {
+        Search::Result result = Search::expectimax(board);
+
+        if (result.move == NULL_MOVE)
+            break;
+
+        if (i % every == 0)
+            positions.push_back(board);
+
+        board = place_random(make_move(board, result.move));
+    }
+
+    return positions;
+}
+
+
+struct GameResult {
+    Bitboard board;
+    int moves;
+    double seconds;     // time spent searching
+};
+
+
+// Play a game from the given seed with expectimax_parallel
+GameResult play_game(unsigned seed) {
+    generator.seed(seed);
+    Bitboard board = place_random(place_random(0x0ULL));
+    GameResult game = {board, 0, 0};
+
+    while (true) {
+        double start = omp_get_wtime();
+        Search::Result result = Search::expectimax_parallel(board);
+        game.seconds += omp_get_wtime() - start;
+
+        if (result.move == NULL_MOVE)
+            break;
+
+        board = place_random(make_move(board, result.move));
+        ++game.moves;
+    }
+
+    game.board = board;
+    return game;
+}
+
+
+/*
+    Count the chance nodes searched (transposition table misses) with the
+    plain evaluation and with the symmetric evaluation, where symmetric
+    boards share table entries.
+*/
+void bench_symmetry(int count) {
+    auto positions = game_positions(count, 20);
+    uint64_t nodes[2] = {0, 0};
+    double time[2] = {0, 0};
+
+    for (Bitboard b: positions) {
+        for (int sym = 0; sym < 2; ++sym) {
+            Search::config.symmetric = sym;
+            TT.clear();
+
+            double start = omp_get_wtime();
+            Search::expectimax(b);
+            time[sym] += omp_get_wtime() - start;
+            nodes[sym] += Search::stats().tt_misses;
+        }
+    }
+
+    Search::config.symmetric = false;
+
+    std::cout << "positions: " << positions.size() << std::endl;
+    std::cout << std::setw(10) << "mode" << std::setw(14) << "nodes" << std::setw(14) << "ms/position" << std::endl;
+
+    const char *names[2] = {"plain", "symmetric"};
+    for (int sym = 0; sym < 2; ++sym) {
+        std::cout << std::setw(10) << names[sym]
+                  << std::setw(14) << nodes[sym]
+                  << std::setw(14) << 1000*time[sym]/positions.size() << std::endl;
+    }
+
+    std::cout << "node reduction: " << 100.0*(1.0 - (double)nodes[1]/nodes[0]) << "%" << std::endl;
+}
+
+
+/*
+    Moves per second with the compact 16 bit row tables against the previous
+    layout, which kept a pre-shifted 64 bit copy of every row result per row
+    (MoveLeftMap/MoveRightMap, 2MB each).
+*/
+void bench_tables(int count) {
+    std::vector<Bitboard> left_map(SHIFTED_ROWS), right_map(SHIFTED_ROWS);
+
+    for (Bitboard b = 0x0ULL; b < UNIQUE_ROWS; ++b) {
+        for (Row r = ROW_1; r <= ROW_4; ++r) {
+            left_map[UNIQUE_ROWS*r+b] = (Bitboard) RowMoveLeft[b] << RowOffset[r];
+            right_map[UNIQUE_ROWS*r+b] = (Bitboard) RowMoveRight[b] << RowOffset[r];
+        }
+    }
+
+    auto shifted_left = [&](Bitboard b) {
+        Bitboard left = 0x0ULL;
+        for (Row r = ROW_1; r <= ROW_4; ++r)
+            left |= left_map[UNIQUE_ROWS*r+get_bits(b, r)];
+        return left;
+    };
+
+    auto shifted_right = [&](Bitboard b) {
+        Bitboard right = 0x0ULL;
+        for (Row r = ROW_1; r <= ROW_4; ++r)
+            right |= right_map[UNIQUE_ROWS*r+get_bits(b, r)];
+        return right;
+    };
+
+    std::vector<Bitboard> boards(count * 1000);
+    for (Bitboard &b: boards)
+        b = Random::board();
+
+    CacheMisses misses;
+    Bitboard sink[2] = {0, 0};
+    long long miss_count[2];
+    double time[2];
+
+    for (int compact = 0; compact < 2; ++compact) {
+        misses.start();
+        double start = omp_get_wtime();
+
+        for (Bitboard b: boards) {
+            if (compact)
+                sink[compact] ^= move_left(b) ^ move_right(b);
+            else
+                sink[compact] ^= shifted_left(b) ^ shifted_right(b);
+        }
+
+        time[compact] = omp_get_wtime() - start;
+        miss_count[compact] = misses.stop();
+    }
+
+    if (sink[0] != sink[1])
+        std::cerr << "Table layouts disagree!" << std::endl;
+
+    const char *names[2] = {"shifted", "compact"};
+    size_t bytes[2] = {2 * SHIFTED_ROWS * sizeof(Bitboard), 2 * UNIQUE_ROWS * sizeof(uint16_t)};
+
+    std::cout << "moves: " << 2 * boards.size() << std::endl;
+    std::cout << std::setw(10) << "layout" << std::setw(14) << "table bytes"
+              << std::setw(14) << "Mmoves/s" << std::setw(16) << "cache misses" << std::endl;
+
+    for (int compact = 0; compact < 2; ++compact) {
+        std::cout << std::setw(10) << names[compact]
+                  << std::setw(14) << bytes[compact]
+                  << std::setw(14) << 2 * boards.size() / time[compact] / 1e6
+                  << std::setw(16);
+
+        if (miss_count[compact] < 0)
+            std::cout << "n/a" << std::endl;
+        else
+            std::cout << miss_count[compact] << std::endl;
+    }
+}
+
+
+/*
+    Speedup and efficiency of expectimax_parallel for every thread count
+    from one to the number of processors, doubling each time.
+*/
+void bench_parallel(int count) {
+    auto positions = game_positions(count, 20);
+    int max_threads = std::max(omp_get_num_procs(), omp_get_max_threads());
+    double base = 0;
+
+    std::cout << "positions: " << positions.size() << std::endl;
+    std::cout << std::setw(8) << "threads" << std::setw(14) << "ms/position"
+              << std::setw(10) << "speedup" << std::setw(12) << "efficiency" << std::endl;
+
+    for (int threads = 1; ; threads = std::min(2 * threads, max_threads)) {
+        Search::config.threads = threads;
+        TT.clear();
+
+        double start = omp_get_wtime();
+        for (Bitboard b: positions)
+            Search::expectimax_parallel(b);
+        double time = omp_get_wtime() - start;
+
+        if (threads == 1)
+            base = time;
+
+        std::cout << std::setw(8) << threads
+                  << std::setw(14) << 1000*time/positions.size()
+                  << std::setw(10) << base/time
+                  << std::setw(12) << base/time/threads << std::endl;
+
+        if (threads == max_threads)
+            break;
+    }
+
+    Search::config.threads = 0;
+}
+
+
+/*
+    Throughput of expectimax_batch in boards per second with a growing number
+    of threads, next to searching the same boards one by one with
+    expectimax_parallel on all threads.
+*/
+void bench_batch(int count) {
+    auto positions = game_positions(count, 20);
+    int max_threads = std::max(omp_get_num_procs(), omp_get_max_threads());
+    double base = 0;
+
+    std::cout << "positions: " << positions.size() << std::endl;
+    std::cout << std::setw(10) << "threads" << std::setw(12) << "boards/s"
+              << std::setw(10) << "speedup" << std::setw(12) << "efficiency" << std::endl;
+
+    for (int threads = 1; ; threads = std::min(2 * threads, max_threads)) {
+        Search::config.threads = threads;
+        TT.clear();
+
+        double start = omp_get_wtime();
+        Search::expectimax_batch(positions.data(), positions.size());
+        double time = omp_get_wtime() - start;
+
+        if (threads == 1)
+            base = time;
+
+        std::cout << std::setw(10) << threads
+                  << std::setw(12) << positions.size()/time
+                  << std::setw(10) << base/time
+                  << std::setw(12) << base/time/threads << std::endl;
+
+        if (threads == max_threads)
+            break;
+    }
+
+    TT.clear();
+    double start = omp_get_wtime();
+    for (Bitboard b: positions)
+        Search::expectimax_parallel(b);
+    double time = omp_get_wtime() - start;
+
+    std::cout << std::setw(10) << "parallel" << std::setw(12) << positions.size()/time
+              << std::setw(10) << base/time << std::setw(12) << base/time/max_threads << std::endl;
+
+    Search::config.threads = 0;
+}
+
+
+/*
+    Play the same games with the fixed and the adaptive depth policy and
+    compare time per move, score and the highest tile reached.
+*/
+void bench_depth(int count) {
+    const char *names[2] = {"fixed", "adaptive"};
+    Search::DepthPolicy policies[2] = {Search::fixed_depth, Search::adaptive_depth};
+
+    std::cout << "games: " << count << std::endl;
+    std::cout << std::setw(10) << "policy" << std::setw(12) << "ms/move" << std::setw(12) << "mean score"
+              << std::setw(14) << "median score" << std::setw(8) << "2048" << std::setw(8) << "4096"
+              << std::setw(8) << "8192" << std::endl;
+
+    for (int p = 0; p < 2; ++p) {
+        Search::config.depth_policy = policies[p];
+        std::vector<int> scores;
+        int reached[3] = {0, 0, 0};
+        double seconds = 0;
+        int moves = 0;
+
+        for (int i = 0; i < count; ++i) {
+            GameResult game = play_game(i + 1);
+            seconds += game.seconds;
+            moves += game.moves;
+            scores.push_back(score(game.board));
+
+            for (int t = 0; t < 3; ++t)
+                reached[t] += max_value(game.board) >= (2048 << t);
+        }
+
+        std::sort(scores.begin(), scores.end());
+        double mean = 0;
+        for (int sc: scores)
+            mean += (double)sc / count;
+
+        std::cout << std::setw(10) << names[p]
+                  << std::setw(12) << 1000*seconds/moves
+                  << std::setw(12) << (int)mean
+                  << std::setw(14) << scores[count / 2];
+
+        for (int t = 0; t < 3; ++t)
+            std::cout << std::setw(8) << reached[t];
+        std::cout << std::endl;
+    }
+
+    Search::config.depth_policy = Search::fixed_depth;
+}
+
+
+/*
+    Chance node reductions against the full search: nodes and time per
+    position, how often the same move is chosen as by the full search,
+    and the score of games played with each. The positions with at least
+    8 empty squares are reported separately, as they are the expensive ones.
+*/
+void bench_pruning(int count) {
+    struct Strategy {
+        const char *name;
+        double chance_cutoff;
+        int four_reduction;
+        int sample_squares;
+    };
+
+    const Strategy strategies[] = {
+        {"full", 0, 0, 0},
+        {"four-1", 0, 1, 0},
+        {"sample-6", 0, 0, 6},
+        {"chance-0.01", 0.01, 0, 0},
+        {"combined", 0.01, 1, 6}
+    };
+
+    auto positions = game_positions(count, 10);
+    int games = std::max(1, count / 10);
+    std::vector<Move> full(positions.size());
+    uint64_t full_nodes = 0;
+
+    std::cout << "positions: " << positions.size() << ", games: " << games << std::endl;
+    std::cout << std::setw(12) << "strategy" << std::setw(12) << "nodes/pos" << std::setw(8) << "saved"
+              << std::setw(12) << "open nodes" << std::setw(10) << "ms/pos" << std::setw(8) << "agree"
+              << std::setw(12) << "mean score" << std::setw(8) << "2048" << std::endl;
+
+    for (const Strategy &st: strategies) {
+        Search::config.chance_cutoff = st.chance_cutoff;
+        Search::config.four_reduction = st.four_reduction;
+        Search::config.sample_squares = st.sample_squares;
+
+        uint64_t nodes = 0, open_nodes = 0;
+        int agree = 0, open = 0;
+        double time = 0;
+
+        for (size_t i = 0; i < positions.size(); ++i) {
+            TT.clear();
+            double start = omp_get_wtime();
+            Move move = Search::expectimax(positions[i]).move;
+            time += omp_get_wtime() - start;
+            nodes += Search::stats().nodes;
+
+            if (empty_squares(positions[i]) >= 8) {
+                open_nodes += Search::stats().nodes;
+                ++open;
+            }
+
+            if (&st == strategies)
+                full[i] = move;
+            agree += move == full[i];
+        }
+
+        if (&st == strategies)
+            full_nodes = nodes;
+
+        double mean = 0;
+        int reached = 0;
+        for (int g = 0; g < games; ++g) {
+            GameResult game = play_game(g + 1);
+            mean += (double)score(game.board) / games;
+            reached += max_value(game.board) >= 2048;
+        }
+
+        std::cout << std::setw(12) << st.name
+                  << std::setw(12) << nodes / positions.size()
+                  << std::setw(7) << (int)(100.0 * (1.0 - (double)nodes / full_nodes)) << "%"
+                  << std::setw(12) << open_nodes / std::max(1, open)
+                  << std::setw(10) << 1000*time/positions.size()
+                  << std::setw(7) << 100 * agree / (int)positions.size() << "%"
+                  << std::setw(12) << (int)mean
+                  << std::setw(8) << reached << std::endl;
+    }
+
+    Search::config.chance_cutoff = 0;
+    Search::config.four_reduction = 0;
+    Search::config.sample_squares = 0;
+}
+
+
+/*
+    Nodes and time of the bounded (Star1) search against the plain search
+    on the same positions, with and without the transposition table.
+*/
+void bench_bounded(int count) {
+    auto positions = game_positions(count, 10);
+
+    std::cout << "positions: " << positions.size() << std::endl;
+    std::cout << std::setw(6) << "tt" << std::setw(10) << "search" << std::setw(12) << "nodes/pos"
+              << std::setw(12) << "cutoffs/pos" << std::setw(10) << "ms/pos" << std::setw(8) << "saved"
+              << std::setw(8) << "agree" << std::endl;
+
+    for (int tt = 1; tt >= 0; --tt) {
+        Search::config.use_tt = tt;
+        std::vector<Move> plain(positions.size());
+        uint64_t plain_nodes = 0;
+
+        for (int bounded = 0; bounded < 2; ++bounded) {
+            Search::config.bounded = bounded;
+            uint64_t nodes = 0, cutoffs = 0;
+            int agree = 0;
+            double time = 0;
+
+            for (size_t i = 0; i < positions.size(); ++i) {
+                TT.clear();
+                double start = omp_get_wtime();
+                Move move = Search::expectimax(positions[i]).move;
+                time += omp_get_wtime() - start;
+
+                nodes += Search::stats().nodes;
+                cutoffs += Search::stats().bound_cutoffs;
+
+                if (!bounded)
+                    plain[i] = move;
+                agree += move == plain[i];
+            }
+
+            if (!bounded)
+                plain_nodes = nodes;
+
+            std::cout << std::setw(6) << (tt ? "on" : "off")
+                      << std::setw(10) << (bounded ? "bounded" : "plain")
+                      << std::setw(12) << nodes / positions.size()
+                      << std::setw(12) << cutoffs / positions.size()
+                      << std::setw(10) << 1000*time/positions.size()
+                      << std::setw(7) << (int)(100.0 * (1.0 - (double)nodes / plain_nodes)) << "%"
+                      << std::setw(7) << 100 * agree / (int)positions.size() << "%" << std::endl;
+        }
+    }
+
+    Search::config.use_tt = true;
+    Search::config.bounded = false;
+}
+
+
+/*
+    Make the compiler assume value is read, and that memory may have been
+    changed, so neither the computation of value nor the loads of the next
+    iteration can be optimized away or hoisted out of a timed loop.
+*/
+template<typename T>
+inline void do_not_optimize(const T &value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+
+template<typename F>
+double ns_per_op(const std::vector<Bitboard> &boards, F f) {
+    double start = omp_get_wtime();
+
+    for (Bitboard b: boards)
+        do_not_optimize(f(b));
+
+    double time = omp_get_wtime() - start;
+    return 1e9 * time / boards.size();
+}
+
+
+// As above, but timing every op on its own after an untimed prepare(b)
+template<typename P, typename F>
+double ns_per_op(const std::vector<Bitboard> &boards, P prepare, F f) {
+    double time = 0;
+
+    for (Bitboard b: boards) {
+        prepare(b);
+        double start = omp_get_wtime();
+        do_not_optimize(f(b));
+        time += omp_get_wtime() - start;
+    }
+
+    return 1e9 * time / boards.size();
+}
+
+
+/*
+    SWAR kernels against the per square loops they replaced.
+*/
+void bench_kernels(int count) {
+    std::vector<Bitboard> boards(count * 1000);
+    for (Bitboard &b: boards)
+        b = (Random::board() & Random::board()) | 0x1ULL;   // some empty squares, never all
+
+    auto loop_empty_squares = [](Bitboard b) {
+        int count = 0;
+        for (Square s = SQ_11; s <= SQ_44; ++s)
+            if (!(b & SquareMask[s])) ++count;
+        return (Bitboard) count;
+    };
+
+    auto loop_max_value = [](Bitboard b) {
+        int max = 0;
+        for (Square s = SQ_11; s <= SQ_44; ++s)
+            max = std::max(max, bits_to_value(get_bits(b, s)));
+        return (Bitboard) max;
+    };
+
+    auto loop_expand = [](Bitboard b) {
+        Bitboard expanded[32];
+        int i = 0;
+        for (Square s = SQ_11; s <= SQ_44; ++s) {
+            if (!(b & SquareMask[s])) {
+                expanded[i++] = b | (0x1ULL << SquareOffset[s]);
+                expanded[i++] = b | (0x2ULL << SquareOffset[s]);
+            }
+        }
+        expanded[i] = 0;
+        return expanded[0] + expanded[i-1];
+    };
+
+    auto swar_expand = [](Bitboard b) {
+        Bitboard expanded[32];
+        Search::expand_inplace(b, expanded);
+        return expanded[0] + expanded[expanded[31]-1];
+    };
+
+    double results[3][2] = {
+        {ns_per_op(boards, loop_empty_squares), ns_per_op(boards, [](Bitboard b) { return (Bitboard) empty_squares(b); })},
+        {ns_per_op(boards, loop_max_value), ns_per_op(boards, [](Bitboard b) { return (Bitboard) max_value(b); })},
+        {ns_per_op(boards, loop_expand), ns_per_op(boards, swar_expand)}
+    };
+
+    const char *names[3] = {"empty_squares", "max_value", "expand_inplace"};
+
+    std::cout << "boards: " << boards.size() << std::endl;
+    std::cout << std::setw(16) << "kernel" << std::setw(12) << "loop ns" << std::setw(12) << "swar ns"
+              << std::setw(10) << "speedup" << std::endl;
+
+    for (int k = 0; k < 3; ++k) {
+        std::cout << std::setw(16) << names[k]
+                  << std::setw(12) << results[k][0]
+                  << std::setw(12) << results[k][1]
+                  << std::setw(10) << results[k][0] / results[k][1] << std::endl;
+    }
+}
+
+
+/*
+    Time to set up the lookup tables: building the row tables from vectors
+    as they used to be, computing them directly, and loading a table file.
+*/
+void bench_startup(int count) {
+    std::string path = "bench_tables.bin";
+    double vectors = 0, computed = 0, loaded = 0;
+    bool ok = true;
+
+    for (int i = 0; i < count; ++i) {
+        double start = omp_get_wtime();
+        for (Bitboard b = 0x0ULL; b < UNIQUE_ROWS; ++b) {
+            Vector v = Bitboards::bitboard_to_vector(b);
+            Vector vl = Bitboards::move_vector_left(v);
+            Vector vr = Bitboards::move_vector_right(v);
+            do_not_optimize(Bitboards::vector_to_bitboard(vl) + Bitboards::vector_to_bitboard(vr));
+        }
+        vectors += omp_get_wtime() - start;
+
+        start = omp_get_wtime();
+        Bitboards::init();
+        Search::init();
+        computed += omp_get_wtime() - start;
+
+        if (i == 0)
+            ok = Tables::save(path.c_str());
+
+        start = omp_get_wtime();
+        ok = Tables::load(path.c_str()) && ok;
+        loaded += omp_get_wtime() - start;
+    }
+
+    remove(path.c_str());
+
+    if (!ok)
+        std::cerr << "Failed to save or load " << path << std::endl;
+
+    std::cout << std::setw(26) << "row tables from vectors" << std::setw(10) << 1000*vectors/count << " ms" << std::endl;
+    std::cout << std::setw(26) << "all tables computed" << std::setw(10) << 1000*computed/count << " ms" << std::endl;
+    std::cout << std::setw(26) << "all tables loaded" << std::setw(10) << 1000*loaded/count << " ms" << std::endl;
+}
+
+
+/*
+    Table size, evaluation speed and search time at every precision, and
+    how often the search on the positions of corpus.txt picks the same
+    move as with double precision.
+*/
+void bench_precision(int count) {
+    std::vector<Regression::Position> positions;
+    if (!Regression::load_corpus("corpus.txt", positions)) {
+        std::cerr << "Could not read corpus.txt" << std::endl;
+        return;
+    }
+
+    generator.seed(1);
+    std::vector<Bitboard> boards(count * 1000);
+    for (Bitboard &b: boards)
+        b = Random::board() & Random::board();
+
+    const char *names[3] = {"double", "float", "fixed"};
+    std::vector<Search::Result> reference(positions.size());
+
+    std::cout << "positions: " << positions.size() << std::endl;
+    std::cout << std::setw(10) << "precision" << std::setw(14) << "table bytes" << std::setw(10) << "eval ns"
+              << std::setw(10) << "ms/pos" << std::setw(8) << "agree" << std::setw(14) << "max value err" << std::endl;
+
+    for (int p = Eval::DOUBLE; p <= Eval::FIXED; ++p) {
+        Eval::set_precision((Eval::Precision) p);
+        double eval_ns = ns_per_op(boards, Eval::evaluate);
+
+        int agree = 0;
+        double time = 0, error = 0;
+
+        for (size_t i = 0; i < positions.size(); ++i) {
+            TT.clear();
+            double start = omp_get_wtime();
+            Search::Result r = Search::expectimax(positions[i].board);
+            time += omp_get_wtime() - start;
+
+            if (p == Eval::DOUBLE)
+                reference[i] = r;
+
+            agree += r.move == reference[i].move;
+            error = std::max(error, std::abs(r.value - reference[i].value) / reference[i].value);
+        }
+
+        std::cout << std::setw(10) << names[p]
+                  << std::setw(14) << Eval::table_bytes()
+                  << std::setw(10) << eval_ns
+                  << std::setw(10) << 1000*time/positions.size()
+                  << std::setw(7) << 100 * agree / (int)positions.size() << "%"
+                  << std::setw(14) << error << std::endl;
+    }
+
+    Eval::set_precision(Eval::DOUBLE);
+}
+
+
+// Print the median and fastest of the ns/op of runs as a JSON line
+void micro_report(const char *name, std::vector<double> &ns, size_t ops, int runs) {
+    std::sort(ns.begin(), ns.end());
+
+    std::cout << "{\"bench\":\"" << name << "\",\"ns_per_op\":" << ns[runs / 2]
+              << ",\"min_ns_per_op\":" << ns[0] << ",\"ops\":" << ops
+              << ",\"runs\":" << runs << "}" << std::endl;
+}
+
+
+/*
+    Time f over all boards runs times and print the median and fastest
+    ns/op as a JSON line, so results can be compared across commits.
+*/
+template<typename F>
+void micro(const char *name, const std::vector<Bitboard> &boards, F f, int runs = 5) {
+    std::vector<double> ns;
+
+    for (int i = 0; i < runs; ++i)
+        ns.push_back(ns_per_op(boards, f));
+
+    micro_report(name, ns, boards.size(), runs);
+}
+
+
+// As above, with prepare(b) run before every op and left out of the time
+template<typename P, typename F>
+void micro_prepared(const char *name, const std::vector<Bitboard> &boards, P prepare, F f, int runs = 5) {
+    std::vector<double> ns;
+
+    for (int i = 0; i < runs; ++i)
+        ns.push_back(ns_per_op(boards, prepare, f));
+
+    micro_report(name, ns, boards.size(), runs);
+}
+
+
+/*
+    ns/op of the bitboard primitives on count thousand random boards, and
+    of a full search on a few positions of a game. Every input comes from a
+    fixed seed and searches start from an empty table, so runs of the same
+    build are repeatable.
+*/
+void bench_micro(int count) {
+    generator.seed(1);
+    std::vector<Bitboard> boards(count * 1000);
+    for (Bitboard &b: boards)
+        b = (Random::board() & Random::board()) | 0x1ULL;   // some empty squares, never all
+
+    PRNG rng;
+
+    micro("move_left", boards, move_left);
+    micro("move_right", boards, move_right);
+    micro("move_up", boards, move_up);
+    micro("move_down", boards, move_down);
+    micro("generate_moves", boards, [](Bitboard b) { PossibleMove moves[MOVE_N]; return generate_moves(b, moves); });
+    micro("possible_moves", boards, [](Bitboard b) { return possible_moves(b).size(); });
+    micro("expand_inplace", boards, [](Bitboard b) { Bitboard expanded[32]; Search::expand_inplace(b, expanded); return expanded[0]; });
+    micro("evaluate", boards, Eval::evaluate);
+    micro("place_random", boards, [&](Bitboard b) { return place_random(b, rng); });
+
+    // A chance node with every child a leaf, with and without AVX2 gathers
+    bool avx2 = Eval::use_avx2;
+    auto expectation = [](Bitboard b) {
+        Bitboard expanded[32];
+        Search::expand_inplace(b, expanded);
+        return Eval::expectation(expanded, expanded[31], 0.9, 0.1);
+    };
+
+    Eval::use_avx2 = false;
+    micro("expectation_scalar", boards, expectation);
+    Eval::use_avx2 = avx2;
+    if (avx2)
+        micro("expectation_avx2", boards, expectation);
+
+    // Every search starts from an empty table, cleared outside the timed part
+    // as clearing it costs more than most searches
+    std::vector<Bitboard> positions = game_positions(8, 25);
+    micro_prepared("expectimax", positions, [](Bitboard) { TT.clear(); },
+                   [](Bitboard b) { return Search::expectimax(b).move; }, 3);
+}
+
+
+/*
+    Usage: 2048cpp bench <name> [count]
+*/
+void benchmark(int argc, char *argv[]) {
+    std::string name = argc > 2 ? argv[2] : "symmetry";
+    int count = argc > 3 ? std::stoi(argv[3]) : 50;
+
+    if (name == "symmetry")
+        bench_symmetry(count);
+    else if (name == "tables")
+        bench_tables(count);
+    else if (name == "parallel")
+        bench_parallel(count);
+    else if (name == "batch")
+        bench_batch(count);
+    else if (name == "depth")
+        bench_depth(count);
+    else if (name == "kernels")
+        bench_kernels(count);
+    else if (name == "startup")
+        bench_startup(count);
+    else if (name == "micro")
+        bench_micro(count);
+    else if (name == "pruning")
+        bench_pruning(count);
+    else if (name == "bounded")
+        bench_bounded(count);
+    else if (name == "precision")
+        bench_precision(count);
+    else
+        std::cerr << "Unknown benchmark: " << name << std::endl;
+}
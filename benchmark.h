@@ -0,0 +1,6 @@
+#ifndef BENCHMARK_H_INCLUDED
+#define BENCHMARK_H_INCLUDED
+
+void benchmark(int argc, char *argv[]);
+
+#endif
@@ -6,6 +6,10 @@
 
 #include <iostream>
 
+#ifdef __BMI2__
+#include <immintrin.h>
+#endif
+
 Bitboard SquareMask[SQUARE_N];
 Bitboard ColMask[COL_N];
 Bitboard RowMask[ROW_N];
@@ -23,27 +27,72 @@ int SquareColNormalize[SQUARE_N] = {
 };
 
 
-Bitboard RowToCol[SHIFTED_COLS];
-
+uint16_t RowReverse[UNIQUE_ROWS];
 
-Bitboard MoveLeftMap[SHIFTED_ROWS];
-Bitboard MoveRightMap[SHIFTED_ROWS];
-Bitboard MoveUpMap[SHIFTED_COLS];
-Bitboard MoveDownMap[SHIFTED_COLS];
+// Result of moving a single row, shifted into place at lookup time
+uint16_t RowMoveLeft[UNIQUE_ROWS];
+uint16_t RowMoveRight[UNIQUE_ROWS];
 
 std::map<int, Bitboard> ValueToBits;
 
-std::default_random_engine generator;
-std::uniform_int_distribution<Bitboard> random_board;
-std::uniform_int_distribution<Bitboard> random_row;
+PRNG generator;
+
+
+/*
+    Move a single row left, working on the 4 bit ranks directly.
+    Gives the same result as move_vector_left, including a merge of
+    two 32768s vanishing as the rank overflows.
+*/
+uint16_t move_row_left(uint16_t row) {
+    int line[4];
+    int out[4] = {0, 0, 0, 0};
+
+    for (int i = 0; i < 4; ++i)
+        line[i] = (row >> (12 - 4*i)) & 0xF;    // leftmost square first
 
+    int pos = 1;
+    bool added = false;
+
+    for (int i = 0; i < 4; ++i) {
+        if (line[i] != 0) {
+            if (out[pos-1] == 0) {
+                out[pos-1] = line[i];
+                added = false;
+            }
+            else if (out[pos-1] == line[i] && !added) {
+                out[pos-1] += 1;
+                added = true;
+                pos++;
+            }
+            else {
+                out[pos] = line[i];
+                added = false;
+                pos++;
+            }
+        }
+    }
+
+    uint16_t moved = 0;
+    for (int i = 0; i < 4; ++i)
+        moved |= (out[i] & 0xF) << (12 - 4*i);
+
+    return moved;
+}
+
+
+uint16_t reverse_row(uint16_t row) {
+    return (row >> 12) | ((row >> 4) & 0x00F0) | ((row << 4) & 0x0F00) | (row << 12);
+}
 
-void Bitboards::init() {
-    unsigned seed = std::chrono::system_clock::now().time_since_epoch().count();
+
+/*
+    Set up masks and offsets. The row tables are skipped when
+    they have already been loaded from a table file.
+*/
+void Bitboards::init(bool row_tables) {
+    uint64_t seed = std::chrono::system_clock::now().time_since_epoch().count();
     
-    generator = std::default_random_engine(seed);
-    random_board = std::uniform_int_distribution<Bitboard>(0, UINT64_MAX);
-    random_row = std::uniform_int_distribution<Bitboard>(0, UNIQUE_ROWS-1);
+    generator.seed(seed);
 
     int value;
     for (Square s = SQ_11; s <= SQ_44; ++s) {
@@ -66,28 +115,16 @@ void Bitboards::init() {
         RowMask[r] = 0xFFFFULL << RowOffset[r];
     }
 
-    for (Bitboard b = 0x0ULL; b < UNIQUE_ROWS; ++b) {
-        Vector v = bitboard_to_vector(b);
-
-        Vector vl = move_vector_left(v);
-        Vector vr = move_vector_right(v);
+    if (!row_tables)
+        return;
 
-        Bitboard bl = vector_to_bitboard(vl);
-        Bitboard br = vector_to_bitboard(vr);
-
-        for (Row r = ROW_1; r <= ROW_4; ++r) {
-            MoveLeftMap[UNIQUE_ROWS*r+b] = bl << RowOffset[r];
-            MoveRightMap[UNIQUE_ROWS*r+b] = br << RowOffset[r];
-        }
-
-        for (Col c = COL_1; c <= COL_4; ++c) {
-            RowToCol[UNIQUE_ROWS*c+b] = row_to_col(b, c);
-            MoveUpMap[UNIQUE_ROWS*c+b] = row_to_col(bl, c);
-            MoveDownMap[UNIQUE_ROWS*c+b] = row_to_col(br, c);
-        }
+    for (int b = 0; b < UNIQUE_ROWS; ++b) {
+        uint16_t reversed = reverse_row(b);
 
+        RowReverse[b] = reversed;
+        RowMoveLeft[b] = move_row_left(b);
+        RowMoveRight[b] = reverse_row(move_row_left(reversed));
     }
-
 }
 
 
@@ -201,54 +238,103 @@ Vector Bitboards::move_vector_right(Vector row) {
 
 
 int empty_squares(Bitboard b) {
-    int count = 0;
+    return __builtin_popcountll(empty_mask(b));
+}
+
+
+/*
+    Bytewise maximum of two bitboards holding values below 0x80 in every
+    byte. Setting the top bit of each byte of a keeps the subtraction from
+    borrowing across bytes, and leaves the top bit set where a >= b.
+*/
+inline Bitboard byte_max(Bitboard a, Bitboard b) {
+    Bitboard ge = ((a | 0x8080808080808080ULL) - b) & 0x8080808080808080ULL;
+    Bitboard mask = (ge >> 7) * 0xFF;
+    return (a & mask) | (b & ~mask);
+}
 
-    for (Square s = SQ_11; s <= SQ_44; ++s) {
-        if (!(b & SquareMask[s])) ++count;
-    }
 
-    return count;
+// Largest square on the board as its 4 bit rank
+int max_rank(Bitboard b) {
+    Bitboard m = byte_max(b & 0x0F0F0F0F0F0F0F0FULL, (b >> 4) & 0x0F0F0F0F0F0F0F0FULL);
+    m = byte_max(m, m >> 32);
+    m = byte_max(m, m >> 16);
+    m = byte_max(m, m >> 8);
+    return m & 0xFF;
 }
 
 
-std::vector<Square> get_empty_squares(Bitboard b) {
-    std::vector<Square> empty;
+int max_value(Bitboard b) {
+    int rank = max_rank(b);
+    return rank ? 1 << rank : 0;
+}
 
-    for (Square s = SQ_11; s <= SQ_44; ++s) {
-        if (!(b & SquareMask[s])) empty.push_back(s);
-    }
 
-    return empty;
+// Number of different tile values on the board
+int distinct_tiles(Bitboard b) {
+    int seen = 0;
+
+    for (Square s = SQ_11; s <= SQ_44; ++s)
+        seen |= 1 << get_bits(b, s);
+
+    return __builtin_popcount(seen & ~1);
 }
 
 
-int max_value(Bitboard b) {
-    int max = 0;
-    int value;
+/*
+    Score of a game that reached the board, assuming every spawned tile was
+    a 2. Making a 2^k tile scores 2^k plus what its two halves scored, which
+    adds up to (k-1)*2^k.
+*/
+int score(Bitboard b) {
+    int total = 0;
 
     for (Square s = SQ_11; s <= SQ_44; ++s) {
-        value = bits_to_value(get_bits(b, s));
-        max = std::max(max, value);
-    }   
+        int rank = get_bits(b, s);
+        if (rank > 1)
+            total += (rank - 1) << rank;
+    }
 
-    return max;
+    return total;
 }
 
 
 Bitboard place_random(Bitboard b) {
-    auto empty = get_empty_squares(b);
+    return place_random(b, generator);
+}
+
+
+/*
+    Select the k-th lowest set bit of a mask, with a single pdep where
+    the CPU has BMI2.
+*/
+inline Bitboard select_bit(Bitboard mask, int k) {
+#ifdef __BMI2__
+    return _pdep_u64(1ULL << k, mask);
+#else
+    for (; k > 0; --k)
+        mask &= mask - 1;
+    return mask & -mask;
+#endif
+}
+
 
-    if (empty.size() == 0)
+/*
+    Place a 2 (probability 0.9) or a 4 (probability 0.1) on a uniformly
+    chosen empty square. Both choices come from a single random number.
+*/
+Bitboard place_random(Bitboard b, PRNG &rng) {
+    Bitboard empty = empty_mask(b);
+
+    if (!empty)
         return b;
 
-    std::uniform_int_distribution<Bitboard> random_pos(0, empty.size()-1);
-    std::uniform_real_distribution<double> rand(0, 1);
+    uint64_t r = rng.rand64();
+    int n = __builtin_popcountll(empty);
+    int k = ((r >> 32) * n) >> 32;
+    Bitboard value = (uint32_t) r < 429496730U ? 2 : 1;   // 0.1 * 2^32
 
-    // get a random position and value for new square
-    int pos = random_pos(generator);
-    Bitboard value = (rand(generator) < 0.1) ? 2 : 1;
-    
-    return (b | (value << SquareOffset[empty[pos]]));
+    return b | select_bit(empty, k) * value;
 }
 
 
@@ -267,12 +353,68 @@ Bitboard row_to_col(Bitboard b, Col c) {
 }
 
 
+/*
+    Mirror the board in its main diagonal, so that square (r, c)
+    ends up at (c, r). Row r of the board becomes column r.
+
+    First the 2x2 blocks of squares are transposed in place, then
+    the four 2x2 quadrants off the diagonal swap places.
+*/
+Bitboard transpose(Bitboard b) {
+    Bitboard a1 = b & 0xF0F00F0FF0F00F0FULL;
+    Bitboard a2 = b & 0x0000F0F00000F0F0ULL;
+    Bitboard a3 = b & 0x0F0F00000F0F0000ULL;
+    Bitboard a = a1 | (a2 << 12) | (a3 >> 12);
+
+    Bitboard b1 = a & 0xFF00FF0000FF00FFULL;
+    Bitboard b2 = a & 0x00FF00FF00000000ULL;
+    Bitboard b3 = a & 0x00000000FF00FF00ULL;
+
+    return b1 | (b2 >> 24) | (b3 << 24);
+}
+
+
+// Reverse the order of the squares in every row
+Bitboard flip_horizontal(Bitboard b) {
+    Bitboard f = 0x0ULL;
+
+    for (Row r = ROW_1; r <= ROW_4; ++r)
+        f |= (Bitboard) RowReverse[get_bits(b, r)] << RowOffset[r];
+
+    return f;
+}
+
+
+// Reverse the order of the rows
+Bitboard flip_vertical(Bitboard b) {
+    b = (b >> 32) | (b << 32);
+    return ((b >> 16) & 0x0000FFFF0000FFFFULL) | ((b & 0x0000FFFF0000FFFFULL) << 16);
+}
+
+
+/*
+    Smallest of the 8 boards reachable through rotations and reflections.
+    Boards that are symmetric to each other share the same canonical form.
+*/
+Bitboard canonical(Bitboard b) {
+    Bitboard h = flip_horizontal(b);
+    Bitboard v = flip_vertical(b);
+    Bitboard hv = flip_vertical(h);
+
+    Bitboard min = std::min(std::min(b, h), std::min(v, hv));
+    min = std::min(min, std::min(transpose(b), transpose(h)));
+    min = std::min(min, std::min(transpose(v), transpose(hv)));
+
+    return min;
+}
+
+
 Bitboard move_left(Bitboard b) {
     Bitboard left = 0x0ULL;
 
     for (Row r = ROW_1; r <= ROW_4; ++r) {
         Bitboard row = get_bits(b, r);
-        left |= MoveLeftMap[UNIQUE_ROWS*r+row];
+        left |= (Bitboard) RowMoveLeft[row] << RowOffset[r];
     }
 
     return left;
@@ -284,33 +426,21 @@ Bitboard move_right(Bitboard b) {
 
     for (Row r = ROW_1; r <= ROW_4; ++r) {
         Bitboard row = get_bits(b, r);
-        right |= MoveRightMap[UNIQUE_ROWS*r+row];
+        right |= (Bitboard) RowMoveRight[row] << RowOffset[r];
     }
 
     return right;
 }
 
 
+// Moving up is moving the columns left, which are the rows of the transposed board
 Bitboard move_up(Bitboard b) {
-    Bitboard up = 0x0ULL;
-
-    for (Col c = COL_1; c <= COL_4; ++c) {
-        Bitboard col = get_bits(b, c);
-        up |= MoveUpMap[UNIQUE_ROWS*c+col];
-    }
-
-    return up;
+    return transpose(move_left(transpose(b)));
 }
 
-Bitboard move_down(Bitboard b) {
-    Bitboard down = 0x0ULL;
-
-    for (Col c = COL_1; c <= COL_4; ++c) {
-        Bitboard col = get_bits(b, c);
-        down |= MoveDownMap[UNIQUE_ROWS*c+col];
-    }
 
-    return down;
+Bitboard move_down(Bitboard b) {
+    return transpose(move_right(transpose(b)));
 }
 
 Bitboard make_move(Bitboard b, Move m) {
@@ -330,16 +460,30 @@ Bitboard make_move(Bitboard b, Move m) {
 
 
 
-std::vector<PossibleMove> possible_moves(Bitboard b) {
-    std::vector<PossibleMove> moves;
-    moves.reserve(4);
-
+/*
+    Fill moves with the legal moves of the board and return how many there
+    are. The board is only transposed once for both vertical moves.
+*/
+int generate_moves(Bitboard b, PossibleMove *moves) {
+    Bitboard t = transpose(b);
+    Bitboard boards[MOVE_N] = {
+        move_left(b),
+        transpose(move_left(t)),
+        transpose(move_right(t)),
+        move_right(b)
+    };
+
+    int n = 0;
     for (Move m = LEFT; m <= RIGHT; ++m) {
-        Bitboard bm = make_move(b, m);
-
-        if (b != bm)
-            moves.push_back({m, bm});
+        if (boards[m] != b)
+            moves[n++] = {m, boards[m]};
     }
 
-    return moves;
-}
\ No newline at end of file
+    return n;
+}
+
+
+std::vector<PossibleMove> possible_moves(Bitboard b) {
+    MoveList moves(b);
+    return std::vector<PossibleMove>(moves.begin(), moves.end());
+}
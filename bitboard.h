@@ -3,9 +3,10 @@
 
 #include <map>
 #include <chrono>
-#include <random>
+#include <string>
 
 #include "types.h"
+#include "prng.h"
 
 
 /* 
@@ -22,19 +23,19 @@ extern int SquareOffset[SQUARE_N];
 extern int RowOffset[ROW_N];
 extern int SquareColNormalize[SQUARE_N];
 
-extern Bitboard RowMoveLeft[UNIQUE_ROWS];
-extern Bitboard RowMoveRight[UNIQUE_ROWS];
+extern uint16_t RowReverse[UNIQUE_ROWS];
+
+extern uint16_t RowMoveLeft[UNIQUE_ROWS];
+extern uint16_t RowMoveRight[UNIQUE_ROWS];
 
 extern std::map<int, Bitboard> ValueToBits;
 
-// Random generator stuff
-extern std::default_random_engine generator;
-extern std::uniform_int_distribution<Bitboard> random_board;
-extern std::uniform_int_distribution<Bitboard> random_row;
+// Shared generator for tests and single games, games played in parallel have their own
+extern PRNG generator;
 
 
 namespace Bitboards {
-    void init();
+    void init(bool row_tables = true);
     std::string pretty(Bitboard b);
     std::string pretty(Move m);
 
@@ -47,8 +48,8 @@ namespace Bitboards {
 
 
 namespace Random {
-    inline Bitboard board() {return random_board(generator);}
-    inline Bitboard row() {return random_row(generator);}
+    inline Bitboard board() {return generator.rand64();}
+    inline Bitboard row() {return generator.rand64() & 0xFFFF;}
 }
 
 
@@ -58,13 +59,41 @@ Bitboard move_up(Bitboard b);
 Bitboard move_down(Bitboard b);
 Bitboard make_move(Bitboard b, Move m);
 Bitboard place_random(Bitboard b);
+Bitboard place_random(Bitboard b, PRNG &rng);
 
 int empty_squares(Bitboard b);
+int max_rank(Bitboard b);
 int max_value(Bitboard b);
+int distinct_tiles(Bitboard b);
+int score(Bitboard b);
 
+int generate_moves(Bitboard b, PossibleMove *moves);
 std::vector<PossibleMove> possible_moves(Bitboard b);
 Bitboard row_to_col(Bitboard b, Col c);
 
+Bitboard transpose(Bitboard b);
+Bitboard flip_horizontal(Bitboard b);
+Bitboard flip_vertical(Bitboard b);
+Bitboard canonical(Bitboard b);
+
+/*
+    Legal moves of a board, kept on the stack. Used in place of
+    possible_moves wherever a heap allocation would hurt.
+*/
+struct MoveList {
+    explicit MoveList(Bitboard b) : n(generate_moves(b, moves)) {}
+
+    const PossibleMove *begin() const { return moves; }
+    const PossibleMove *end() const { return moves + n; }
+    const PossibleMove &operator[](int i) const { return moves[i]; }
+    size_t size() const { return n; }
+
+private:
+    PossibleMove moves[MOVE_N];
+    int n;
+};
+
+
 inline int bits_to_value(Bitboard s) {
     return 2 << (s - 1);    // if s=0 then s-1=UINT_MAX so this returns 0
 }
@@ -73,6 +102,14 @@ inline Bitboard value_to_bits(int value) {
     return ValueToBits[value];
 }
 
+// Bitboard with the lowest bit of every empty square set
+inline Bitboard empty_mask(Bitboard b) {
+    Bitboard x = b | (b >> 1);
+    x |= x >> 2;
+    return ~x & 0x1111111111111111ULL;
+}
+
+
 inline Square make_square(Row r, Col c) {
     return Square(c | r << 2); // multply row by 4 and add c
 }
@@ -0,0 +1,438 @@
+#include "eval.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+
+#include "bitboard.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define EVAL_AVX2
+#endif
+
+
+const Eval::Weights Eval::Default = {
+    {
+        1.00, 0.83, 0.66, 0.50,
+        0.84, 0.67, 0.51, 0.33,
+        0.68, 0.52, 0.34, 0.17,
+        0.53, 0.35, 0.18, 0.00
+    },
+    0.01, 0, 0, 0, 0
+};
+
+const Eval::Weights Eval::Snake = {
+    {
+        15/15.0, 14/15.0, 13/15.0, 12/15.0,
+         8/15.0,  9/15.0, 10/15.0, 11/15.0,
+         7/15.0,  6/15.0,  5/15.0,  4/15.0,
+         0/15.0,  1/15.0,  2/15.0,  3/15.0
+    },
+    0.01, 0, 0, 0, 0
+};
+
+Eval::Weights Eval::weights = Eval::Default;
+
+double Eval::RowValue[SHIFTED_ROWS];
+double Eval::ColValue[UNIQUE_ROWS];
+
+// Set when any column feature has a weight, otherwise ColValue is all zero
+bool use_columns = false;
+
+bool Eval::use_avx2 = false;
+
+Eval::Precision Eval::precision = Eval::DOUBLE;
+
+// Reduced precision tables: the row tables (one or four rows) followed by
+// the column table, so that both stay close together in the cache
+float RowValueF[SHIFTED_ROWS + UNIQUE_ROWS];
+int32_t RowValueI[SHIFTED_ROWS + UNIQUE_ROWS];
+float *ColValueF = RowValueF + SHIFTED_ROWS;
+int32_t *ColValueI = RowValueI + SHIFTED_ROWS;
+
+// Distance between the tables of two rows, 0 when the rows share a table
+int row_stride = UNIQUE_ROWS;
+
+// Fixed point values are the evaluation times FixedScale
+double FixedScale = 1;
+
+// Largest value of a row in each row table and of a column, among the
+// lines without a tile above each rank
+const int RANK_N = 16;
+double RowMax[ROW_N][RANK_N];
+double ColMax[RANK_N];
+
+
+/*
+    Weighted line features of a single row or column. The empty
+    square count is only included for rows.
+*/
+double line_value(const int rank[4], const Eval::Weights &w, bool row) {
+    double value = 0;
+
+    if (w.monotonicity) {
+        double up = 0, down = 0;
+        for (int i = 1; i < 4; ++i) {
+            double a = std::pow(rank[i-1], 4), b = std::pow(rank[i], 4);
+            if (a > b) down += a - b;
+            else up += b - a;
+        }
+        value -= w.monotonicity * std::min(up, down);
+    }
+
+    if (w.smoothness) {
+        for (int i = 1; i < 4; ++i) {
+            if (rank[i-1] && rank[i])
+                value -= w.smoothness * std::abs(rank[i-1] - rank[i]);
+        }
+    }
+
+    if (w.merges) {
+        int prev = 0;
+        for (int i = 0; i < 4; ++i) {
+            if (!rank[i])
+                continue;
+            if (rank[i] == prev)
+                value += w.merges;
+            prev = rank[i];
+        }
+    }
+
+    if (w.empty && row) {
+        for (int i = 0; i < 4; ++i)
+            value += w.empty * (rank[i] == 0);
+    }
+
+    return value;
+}
+
+
+// Largest line values by rank from the double tables, for upper_bound
+void build_bounds() {
+    for (int k = 0; k < RANK_N; ++k) {
+        ColMax[k] = std::numeric_limits<double>::lowest();
+        for (Row r = ROW_1; r <= ROW_4; ++r)
+            RowMax[r][k] = std::numeric_limits<double>::lowest();
+    }
+
+    for (Bitboard b = 0x0ULL; b < UNIQUE_ROWS; ++b) {
+        int k = max_rank(b);
+        ColMax[k] = std::max(ColMax[k], Eval::ColValue[b]);
+        for (Row r = ROW_1; r <= ROW_4; ++r)
+            RowMax[r][k] = std::max(RowMax[r][k], Eval::RowValue[UNIQUE_ROWS * r + b]);
+    }
+
+    for (int k = 1; k < RANK_N; ++k) {
+        ColMax[k] = std::max(ColMax[k], ColMax[k-1]);
+        for (Row r = ROW_1; r <= ROW_4; ++r)
+            RowMax[r][k] = std::max(RowMax[r][k], RowMax[r][k-1]);
+    }
+}
+
+
+// Fold the weights into the double tables
+void build_tables(const Eval::Weights &w) {
+    for (Bitboard b = 0x0ULL; b < UNIQUE_ROWS; ++b) {
+        int empty = empty_squares(b) - 12;
+        double empty_score = 1.0 + w.empty_factor*empty;
+
+        int rank[4];
+        for (Square s = SQ_11; s <= SQ_14; ++s)
+            rank[s] = get_bits(b, s);
+
+        double line = line_value(rank, w, true);
+
+        for (Row r = ROW_1; r <= ROW_4; ++r) {
+            double value = 0;
+            for (Square s = SQ_11; s <= SQ_14; ++s) {
+                double g = w.gradient[4*r + s];
+                value += g * g * bits_to_value(rank[s]) * empty_score;
+            }
+
+            Eval::RowValue[UNIQUE_ROWS * r + b] = value + line;
+        }
+
+        Eval::ColValue[b] = line_value(rank, w, false);
+    }
+}
+
+
+/*
+    Set the weights and fold them into the lookup tables. The tables are
+    left alone when they have already been loaded from a table file.
+*/
+void Eval::init(const Weights &w, bool tables) {
+    weights = w;
+    use_columns = w.monotonicity || w.smoothness || w.merges;
+
+#ifdef EVAL_AVX2
+    use_avx2 = __builtin_cpu_supports("avx2");
+#endif
+
+    if (tables)
+        build_tables(w);
+
+    build_bounds();
+    set_precision(precision);
+}
+
+
+/*
+    Derive the float or fixed point tables from the double ones. When all
+    four rows share the same values, as with a gradient that is the same
+    on every row, a single row's table is kept and indexed for every row.
+*/
+void Eval::set_precision(Precision p) {
+    precision = p;
+
+    if (p == DOUBLE)
+        return;
+
+    bool same_rows = true;
+    for (Row r = ROW_2; r <= ROW_4 && same_rows; ++r)
+        same_rows = std::equal(RowValue, RowValue + UNIQUE_ROWS, RowValue + UNIQUE_ROWS * r);
+
+    row_stride = same_rows ? 0 : UNIQUE_ROWS;
+    int rows = same_rows ? 1 : ROW_N;
+
+    if (p == FLOAT) {
+        std::copy(RowValue, RowValue + rows * UNIQUE_ROWS, RowValueF);
+        std::copy(ColValue, ColValue + UNIQUE_ROWS, RowValueF + rows * UNIQUE_ROWS);
+        ColValueF = RowValueF + rows * UNIQUE_ROWS;
+        return;
+    }
+
+    // Largest power of two scale that keeps every evaluation within 30 bits
+    double bound = 0;
+    for (Row r = ROW_1; r <= ROW_4; ++r) {
+        const double *row = RowValue + UNIQUE_ROWS * r;
+        bound += std::abs(*std::max_element(row, row + UNIQUE_ROWS, [](double a, double b) { return std::abs(a) < std::abs(b); }));
+    }
+    bound += 4 * std::abs(*std::max_element(ColValue, ColValue + UNIQUE_ROWS, [](double a, double b) { return std::abs(a) < std::abs(b); }));
+
+    FixedScale = std::ldexp(1.0, std::ilogb(std::ldexp(1.0, 30) / std::max(bound, 1.0)));
+
+    for (int i = 0; i < rows * UNIQUE_ROWS; ++i)
+        RowValueI[i] = (int32_t) std::lround(RowValue[i] * FixedScale);
+    for (int i = 0; i < UNIQUE_ROWS; ++i)
+        RowValueI[rows * UNIQUE_ROWS + i] = (int32_t) std::lround(ColValue[i] * FixedScale);
+
+    ColValueI = RowValueI + rows * UNIQUE_ROWS;
+}
+
+
+// Bytes of the tables read by evaluate at the current precision
+size_t Eval::table_bytes() {
+    int rows = row_stride ? ROW_N : 1;
+
+    switch (precision) {
+        case FLOAT:
+            return (rows + 1) * UNIQUE_ROWS * sizeof(float);
+        case FIXED:
+            return (rows + 1) * UNIQUE_ROWS * sizeof(int32_t);
+        default:
+            return sizeof(RowValue) + sizeof(ColValue);
+    }
+}
+
+
+/*
+    Upper bound of the evaluation of any board without a tile above rank,
+    at every precision: the float and fixed point values may round a little
+    above the double ones.
+*/
+double Eval::upper_bound(int rank) {
+    rank = std::min(rank, RANK_N - 1);
+
+    double bound = use_columns ? 4 * ColMax[rank] : 0;
+    for (Row r = ROW_1; r <= ROW_4; ++r)
+        bound += RowMax[r][rank];
+
+    return bound + 1e-3 + 1e-6 * std::abs(bound);
+}
+
+
+// Fingerprint of the weights, so that a saved table file is not used with other weights
+uint64_t Eval::fingerprint() {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    const unsigned char *bytes = (const unsigned char*) &weights;
+
+    for (size_t i = 0; i < sizeof(weights); ++i)
+        hash = (hash ^ bytes[i]) * 0x100000001b3ULL;
+
+    return hash;
+}
+
+
+float evaluate_float(Bitboard b) {
+    float value = 0;
+
+    for (Row r = ROW_1; r <= ROW_4; ++r)
+        value += RowValueF[row_stride * r + get_bits(b, r)];
+
+    if (use_columns) {
+        Bitboard t = transpose(b);
+        for (Row r = ROW_1; r <= ROW_4; ++r)
+            value += ColValueF[get_bits(t, r)];
+    }
+
+    return value;
+}
+
+
+int32_t evaluate_fixed(Bitboard b) {
+    int32_t value = 0;
+
+    for (Row r = ROW_1; r <= ROW_4; ++r)
+        value += RowValueI[row_stride * r + get_bits(b, r)];
+
+    if (use_columns) {
+        Bitboard t = transpose(b);
+        for (Row r = ROW_1; r <= ROW_4; ++r)
+            value += ColValueI[get_bits(t, r)];
+    }
+
+    return value;
+}
+
+
+double Eval::evaluate(Bitboard b) {
+    if (precision == FLOAT)
+        return evaluate_float(b);
+    if (precision == FIXED)
+        return evaluate_fixed(b) / FixedScale;
+
+    double value = 0;
+    for (Row r = ROW_1; r <= ROW_4; ++r)
+        value += RowValue[UNIQUE_ROWS * r + get_bits(b, r)];
+
+    if (use_columns) {
+        Bitboard t = transpose(b);
+        for (Row r = ROW_1; r <= ROW_4; ++r)
+            value += ColValue[get_bits(t, r)];
+    }
+
+    return value;
+}
+
+
+/*
+    The float version sums in float. The fixed point version sums the
+    values of the boards with a 2 and with a 4 exactly, and only applies
+    the probabilities and the scale at the end.
+*/
+double expectation_float(const Bitboard *boards, int n, float prob2, float prob4) {
+    float value = 0;
+
+    for (int i = 0; i < n; i += 2)
+        value += prob2*evaluate_float(boards[i]) + prob4*evaluate_float(boards[i+1]);
+
+    return value;
+}
+
+
+double expectation_fixed(const Bitboard *boards, int n, double prob2, double prob4) {
+    int64_t sum2 = 0, sum4 = 0;
+
+    for (int i = 0; i < n; i += 2) {
+        sum2 += evaluate_fixed(boards[i]);
+        sum4 += evaluate_fixed(boards[i+1]);
+    }
+
+    return (prob2*sum2 + prob4*sum4) / FixedScale;
+}
+
+
+double expectation_scalar(const Bitboard *boards, int n, double prob2, double prob4) {
+    double value = 0;
+
+    for (int i = 0; i < n; i += 2)
+        value += prob2*Eval::evaluate(boards[i]) + prob4*Eval::evaluate(boards[i+1]);
+
+    return value;
+}
+
+
+#ifdef EVAL_AVX2
+
+// transpose() on four boards at once
+__attribute__((target("avx2")))
+inline __m256i transpose4(__m256i b) {
+    __m256i a1 = _mm256_and_si256(b, _mm256_set1_epi64x(0xF0F00F0FF0F00F0FULL));
+    __m256i a2 = _mm256_and_si256(b, _mm256_set1_epi64x(0x0000F0F00000F0F0ULL));
+    __m256i a3 = _mm256_and_si256(b, _mm256_set1_epi64x(0x0F0F00000F0F0000ULL));
+    __m256i a = _mm256_or_si256(a1, _mm256_or_si256(_mm256_slli_epi64(a2, 12), _mm256_srli_epi64(a3, 12)));
+
+    __m256i b1 = _mm256_and_si256(a, _mm256_set1_epi64x(0xFF00FF0000FF00FFULL));
+    __m256i b2 = _mm256_and_si256(a, _mm256_set1_epi64x(0x00FF00FF00000000ULL));
+    __m256i b3 = _mm256_and_si256(a, _mm256_set1_epi64x(0x00000000FF00FF00ULL));
+
+    return _mm256_or_si256(b1, _mm256_or_si256(_mm256_srli_epi64(b2, 24), _mm256_slli_epi64(b3, 24)));
+}
+
+
+/*
+    Four boards per step: the table lookups of all four are gathered at
+    once, and the weighted values are summed in a vector register.
+*/
+__attribute__((target("avx2")))
+inline __m256d gather_lines(__m256i b, const double *table, int stride) {
+    const __m256i mask = _mm256_set1_epi64x(0xFFFF);
+
+    __m256d v0 = _mm256_i64gather_pd(table, _mm256_and_si256(b, mask), 8);
+    __m256d v1 = _mm256_i64gather_pd(table + stride, _mm256_and_si256(_mm256_srli_epi64(b, 16), mask), 8);
+    __m256d v2 = _mm256_i64gather_pd(table + 2*stride, _mm256_and_si256(_mm256_srli_epi64(b, 32), mask), 8);
+    __m256d v3 = _mm256_i64gather_pd(table + 3*stride, _mm256_srli_epi64(b, 48), 8);
+
+    return _mm256_add_pd(_mm256_add_pd(v0, v1), _mm256_add_pd(v2, v3));
+}
+
+
+__attribute__((target("avx2")))
+double expectation_avx2(const Bitboard *boards, int n, double prob2, double prob4) {
+    const __m256d prob = _mm256_setr_pd(prob2, prob4, prob2, prob4);
+    __m256d sum = _mm256_setzero_pd();
+    int i = 0;
+
+    if (use_columns) {
+        for (; i + 4 <= n; i += 4) {
+            __m256i b = _mm256_loadu_si256((const __m256i*)(boards + i));
+            __m256d value = _mm256_add_pd(gather_lines(b, Eval::RowValue, UNIQUE_ROWS),
+                                          gather_lines(transpose4(b), Eval::ColValue, 0));
+            sum = _mm256_add_pd(sum, _mm256_mul_pd(prob, value));
+        }
+    }
+    else {
+        for (; i + 4 <= n; i += 4) {
+            __m256i b = _mm256_loadu_si256((const __m256i*)(boards + i));
+            sum = _mm256_add_pd(sum, _mm256_mul_pd(prob, gather_lines(b, Eval::RowValue, UNIQUE_ROWS)));
+        }
+    }
+
+    __m128d half = _mm_add_pd(_mm256_castpd256_pd128(sum), _mm256_extractf128_pd(sum, 1));
+    double value = _mm_cvtsd_f64(_mm_add_sd(half, _mm_unpackhi_pd(half, half)));
+
+    return value + expectation_scalar(boards + i, n - i, prob2, prob4);
+}
+
+#endif
+
+
+/*
+    Expected value of the boards of a chance node, where the boards at even
+    indices have probability prob2 and the ones at odd indices prob4.
+*/
+double Eval::expectation(const Bitboard *boards, int n, double prob2, double prob4) {
+    if (precision == FLOAT)
+        return expectation_float(boards, n, prob2, prob4);
+    if (precision == FIXED)
+        return expectation_fixed(boards, n, prob2, prob4);
+
+#ifdef EVAL_AVX2
+    if (use_avx2)
+        return expectation_avx2(boards, n, prob2, prob4);
+#endif
+    return expectation_scalar(boards, n, prob2, prob4);
+}
@@ -0,0 +1,68 @@
+#ifndef EVAL_H_INCLUDED
+#define EVAL_H_INCLUDED
+
+#include <cstddef>
+
+#include "types.h"
+
+/*
+    Heuristic evaluation as a weighted sum of features that decompose over
+    the rows and columns of the board. Every feature is folded into a lookup
+    table when the weights are set, so evaluating a board takes four row
+    lookups, plus four column lookups when any column feature is in use.
+
+    Line features (each row and column, squares in order):
+        monotonicity    minus the smaller of the rank increases and decreases
+                        along the line, ranks taken to the 4th power
+        smoothness      minus the rank differences between neighbouring tiles
+        merges          number of neighbouring equal tiles, ignoring gaps
+        empty           number of empty squares (rows only, not counted twice)
+*/
+namespace Eval {
+
+    struct Weights {
+        double gradient[SQUARE_N];  // per square weight, squared and multiplied by the tile value
+        double empty_factor;        // gradient term of a row is scaled by 1 + empty_factor * empty squares
+        double monotonicity;
+        double smoothness;
+        double merges;
+        double empty;
+    };
+
+    // DiagLinGrad: pull the tiles towards SQ_11 along the diagonals
+    extern const Weights Default;
+    // StepGrad: pull the tiles along a snake through the rows
+    extern const Weights Snake;
+
+    extern Weights weights;
+
+    extern double RowValue[SHIFTED_ROWS];
+    extern double ColValue[UNIQUE_ROWS];
+
+    // Set by init when the CPU has AVX2. Clear it to force the scalar code.
+    extern bool use_avx2;
+
+    /*
+        Precision of the tables read by evaluate. The float and fixed point
+        (int32) tables are half the size of the double ones and are derived
+        from them, so the double tables are still built and cached.
+    */
+    enum Precision {
+        DOUBLE,
+        FLOAT,
+        FIXED
+    };
+
+    extern Precision precision;
+
+    void init(const Weights &w, bool tables = true);
+    void set_precision(Precision p);
+    size_t table_bytes();
+    uint64_t fingerprint();
+    double upper_bound(int rank);
+
+    double evaluate(Bitboard b);
+    double expectation(const Bitboard *boards, int n, double prob2, double prob4);
+}
+
+#endif
@@ -0,0 +1,37 @@
+#include "game.h"
+
+#include "bitboard.h"
+
+
+Game::Game(uint64_t seed) : rng(seed) {
+    spawn();
+    spawn();
+}
+
+
+// The score of the board minus the 4s that were spawned rather than merged
+int Game::score() const {
+    return ::score(b) - 4 * fours;
+}
+
+
+bool Game::over() const {
+    return MoveList(b).size() == 0;
+}
+
+
+void Game::play(Move m) {
+    b = make_move(b, m);
+    ++move_count;
+    spawn();
+}
+
+
+void Game::spawn() {
+    Bitboard placed = place_random(b, rng);
+
+    if ((placed ^ b) & 0x2222222222222222ULL)   // the new square holds a 4
+        ++fours;
+
+    b = placed;
+}
@@ -0,0 +1,32 @@
+#ifndef GAME_H_INCLUDED
+#define GAME_H_INCLUDED
+
+#include "types.h"
+#include "prng.h"
+
+
+/*
+    A single game with its own random generator, so games can be played
+    in parallel and every game can be replayed from its seed.
+*/
+class Game {
+public:
+    explicit Game(uint64_t seed);
+
+    Bitboard board() const { return b; }
+    int moves() const { return move_count; }
+    int score() const;
+    bool over() const;
+
+    void play(Move m);
+
+private:
+    void spawn();
+
+    PRNG rng;
+    Bitboard b = 0x0ULL;
+    int move_count = 0;
+    int fours = 0;
+};
+
+#endif
@@ -0,0 +1,192 @@
+#include "gamelog.h"
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bitboard.h"
+#include "search.h"
+#include "selfplay.h"
+#include "tt.h"
+
+using namespace GameLog;
+
+const char MAGIC[8] = {'2', '0', '4', '8', 'L', 'O', 'G', '1'};
+const size_t GAME_HEADER = 12;
+
+
+uint8_t GameLog::encode(Move m, Bitboard moved, Bitboard spawned) {
+    Bitboard diff = spawned ^ moved;
+    int square = __builtin_ctzll(diff) / 4;
+    int four = (diff >> 4 * square) == 2;
+
+    return m | square << 2 | four << 6;
+}
+
+
+bool Writer::open(const std::string &path) {
+    out.open(path, std::ios::binary | std::ios::trunc);
+    out.write(MAGIC, sizeof(MAGIC));
+    return out.good();
+}
+
+
+void Record::begin(uint64_t seed, Bitboard start) {
+    this->seed = seed;
+    entries.clear();
+
+    // The opening tiles, in square order
+    Bitboard board = 0;
+    for (int sq = 0; sq < SQUARE_N; ++sq) {
+        Bitboard tile = start & 0xFULL << 4 * sq;
+        if (tile) {
+            entries.push_back(encode(LEFT, board, board | tile));
+            board |= tile;
+        }
+    }
+}
+
+
+void Writer::write(const Record &record) {
+    uint8_t header[GAME_HEADER];
+    uint64_t seed = record.seed;
+    uint32_t size = record.entries.size();
+
+    for (int i = 0; i < 8; ++i)
+        header[i] = seed >> 8 * i;
+    for (int i = 0; i < 4; ++i)
+        header[8 + i] = size >> 8 * i;
+
+    out.write((const char *)header, GAME_HEADER);
+    out.write(record.entries.data(), size);
+}
+
+
+Bitboard GameLog::Game::start() const {
+    return spawn(entries[1], spawn(entries[0], 0));
+}
+
+
+Reader::~Reader() {
+    if (data)
+        munmap((void *)data, length);
+}
+
+
+bool Reader::open(const std::string &path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(MAGIC)) {
+        close(fd);
+        return false;
+    }
+
+    void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (p == MAP_FAILED)
+        return false;
+
+    data = (const uint8_t *)p;
+    length = st.st_size;
+    offset = sizeof(MAGIC);
+    madvise(p, length, MADV_SEQUENTIAL);
+
+    return memcmp(data, MAGIC, sizeof(MAGIC)) == 0;
+}
+
+
+// The next complete game. A game cut off by an interrupted writer ends the log
+bool Reader::next(Game &game) {
+    if (offset + GAME_HEADER > length)
+        return false;
+
+    const uint8_t *p = data + offset;
+    game.seed = 0;
+    game.size = 0;
+
+    for (int i = 0; i < 8; ++i)
+        game.seed |= (uint64_t)p[i] << 8 * i;
+    for (int i = 0; i < 4; ++i)
+        game.size |= (uint32_t)p[8 + i] << 8 * i;
+
+    if (game.size < 2 || offset + GAME_HEADER + game.size > length)
+        return false;
+
+    game.entries = p + GAME_HEADER;
+    offset += GAME_HEADER + game.size;
+    return true;
+}
+
+
+/*
+    Every game is replayed the way SelfPlay::run played it: serially on one
+    thread, with a table of the same size that is cleared when the game
+    starts. Values in the table depend on the order they were stored in,
+    so this is what makes an unchanged build replay without differences.
+    Games are spread over the threads, and reported in the order of the log.
+*/
+long GameLog::replay(const std::string &path, long max_games, std::ostream &out) {
+    Reader reader;
+    if (!reader.open(path))
+        return -1;
+
+    std::vector<Game> games;
+    Game next;
+    while ((!max_games || (long)games.size() < max_games) && reader.next(next))
+        games.push_back(next);
+
+    std::vector<std::string> reports(games.size());
+    long moves = 0, diffs = 0;
+    size_t tt_mb = SelfPlay::Options().tt_mb;
+
+    #pragma omp parallel reduction(+:moves, diffs)
+    {
+        TranspositionTable tt;
+        tt.resize(tt_mb);
+        Search::set_table(&tt);
+
+        #pragma omp for schedule(dynamic, 1)
+        for (size_t g = 0; g < games.size(); ++g) {
+            const Game &game = games[g];
+            std::ostringstream report;
+            Bitboard board = game.start();
+            tt.clear();
+
+            for (uint32_t i = 2; i < game.size; ++i) {
+                Move logged = move(game.entries[i]);
+                Search::Result r = Search::expectimax(board);
+
+                if (r.move != logged) {
+                    report << "game " << game.seed << " move " << i - 1 << ": logged "
+                           << Bitboards::pretty(logged) << ", searched " << Bitboards::pretty(r.move) << std::endl;
+                    ++diffs;
+                }
+
+                board = spawn(game.entries[i], make_move(board, logged));
+            }
+
+            reports[g] = report.str();
+            moves += game.moves();
+        }
+
+        Search::set_table(&TT);
+    }
+
+    for (const std::string &report: reports)
+        out << report;
+
+    out << "games: " << games.size() << ", moves: " << moves << ", differing: " << diffs
+        << " (" << 100.0 * diffs / std::max(1L, moves) << "%)" << std::endl;
+
+    return diffs;
+}
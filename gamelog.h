@@ -0,0 +1,90 @@
+#ifndef GAMELOG_H_INCLUDED
+#define GAMELOG_H_INCLUDED
+
+#include <cstddef>
+#include <fstream>
+#include <ostream>
+#include <string>
+
+#include "types.h"
+
+/*
+    Binary log of played games, one byte per move.
+
+    A file starts with the 8 byte magic "2048LOG1", followed by the games.
+    Every game is its seed (8 bytes), the number of entries (4 bytes), both
+    little endian, and one byte per entry:
+
+        bits 0-1  move
+        bits 2-5  square of the spawned tile
+        bit  6    the spawned tile is a 4 rather than a 2
+
+    The first two entries place the tiles of the opening board and their
+    move bits are unused. Every later entry is a move and the tile spawned
+    after it, so the boards of a game follow from its entries alone.
+*/
+namespace GameLog {
+
+    uint8_t encode(Move m, Bitboard moved, Bitboard spawned);
+
+    inline Move move(uint8_t entry) { return Move(entry & 3); }
+
+    // The board after the spawn of entry, given the board before it
+    inline Bitboard spawn(uint8_t entry, Bitboard moved) {
+        return moved | Bitboard((entry >> 6 & 1) + 1) << 4 * (entry >> 2 & 15);
+    }
+
+    // The entries of a game being played
+    struct Record {
+        uint64_t seed = 0;
+        std::string entries;
+
+        void begin(uint64_t seed, Bitboard start);
+        void move(Move m, Bitboard moved, Bitboard spawned) { entries.push_back(encode(m, moved, spawned)); }
+    };
+
+    // Appends games to a log as they finish. Not thread safe
+    class Writer {
+    public:
+        bool open(const std::string &path);
+        void write(const Record &record);
+        void close() { out.close(); }
+        bool good() const { return out.good(); }
+
+    private:
+        std::ofstream out;
+    };
+
+    struct Game {
+        uint64_t seed;
+        const uint8_t *entries;
+        uint32_t size;
+
+        int moves() const { return size - 2; }
+        Bitboard start() const;
+    };
+
+    // Maps a whole log into memory and walks its games
+    class Reader {
+    public:
+        ~Reader();
+
+        bool open(const std::string &path);
+        bool next(Game &game);
+
+    private:
+        const uint8_t *data = nullptr;
+        size_t length = 0;
+        size_t offset = 0;
+    };
+
+    /*
+        Replay the games of a log, search every position again with the
+        current settings and print the moves that differ from the log.
+        Returns the number of differing moves, or -1 if the log can not
+        be read.
+    */
+    long replay(const std::string &path, long max_games, std::ostream &out);
+}
+
+#endif
@@ -1,14 +1,46 @@
 #include <iostream>
 #include <ctime>
 #include <cassert>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdio>
+#include <cmath>
+#include <fstream>
+#include <atomic>
+#include <new>
+#include <thread>
 
 #include "types.h"
 #include "bitboard.h"
 #include "search.h"
+#include "tt.h"
+#include "benchmark.h"
+#include "selfplay.h"
+#include "tables.h"
+#include "eval.h"
+#include "tune.h"
+#include "ntuple.h"
+#include "regression.h"
+#include "server.h"
+#include "gamelog.h"
+#include "game.h"
 #include "omp.h"
 
-extern int evaluation_count;
-extern int probability_cutoffs;
+
+// Every heap allocation made through operator new, so tests can check that the search makes none
+std::atomic<long> allocations(0);
+
+void *operator new(size_t size) {
+    ++allocations;
+
+    if (void *p = malloc(size ? size : 1))
+        return p;
+
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
 
 
 // Tests symmetry of vector to/from bitboard function
@@ -30,14 +62,546 @@ bool test_bitboard_conversion() {
 }
 
 
-bool time_left_right() {
+// Tests the row move tables against moving every row as a vector
+bool test_row_tables() {
+    for (Bitboard b = 0x0ULL; b < UNIQUE_ROWS; ++b) {
+        Vector v = Bitboards::bitboard_to_vector(b);
+        Vector vl = Bitboards::move_vector_left(v);
+        Vector vr = Bitboards::move_vector_right(v);
+
+        if (RowMoveLeft[b] != Bitboards::vector_to_bitboard(vl) || RowMoveRight[b] != Bitboards::vector_to_bitboard(vr))
+            return false;
+    }
+
+    return true;
+}
+
+
+// Tests that the line features are the same for rows and columns and in either direction
+bool test_evaluation() {
+    int num_tests = 10000;
+
+    Eval::Weights saved = Eval::weights;
+    Eval::Weights w = {};
+    w.monotonicity = 1;
+    w.smoothness = 2;
+    w.merges = 3;
+    Eval::init(w);
+
+    bool passed = true;
+    for (int i = 0; i < num_tests && passed; ++i) {
+        Bitboard b = Random::board() & Random::board();
+        double value = Eval::evaluate(b);
+
+        passed = value == Eval::evaluate(transpose(b)) && value == Eval::evaluate(flip_horizontal(b));
+    }
+
+    Eval::init(saved);
+    return passed;
+}
+
+
+// Tests that the batched chance node evaluation agrees with evaluating the boards one by one
+bool test_expectation() {
+    Eval::Weights saved = Eval::weights;
+    Eval::Weights w = Eval::Default;
+    w.monotonicity = 1;
+    w.merges = 3;
+
+    bool passed = true;
+    for (int columns = 0; columns < 2; ++columns) {
+        Eval::init(columns ? w : Eval::Default);
+
+        for (int i = 0; i < 1000 && passed; ++i) {
+            Bitboard expanded[32];
+            Search::expand_inplace(Random::board() & Random::board(), expanded);
+            int n = expanded[31];
+
+            double expected = 0;
+            for (int j = 0; j < n; j += 2)
+                expected += 0.9*Eval::evaluate(expanded[j]) + 0.1*Eval::evaluate(expanded[j+1]);
+
+            double value = Eval::expectation(expanded, n, 0.9, 0.1);
+            passed = std::abs(value - expected) <= 1e-9 * std::abs(expected);
+        }
+    }
+
+    Eval::init(saved);
+    return passed;
+}
+
+
+// Tests that the float and fixed point tables evaluate close to the double ones
+bool test_precision() {
+    Eval::Weights w = Eval::Default;
+    w.monotonicity = 1;
+    w.merges = 3;
+    for (int s = 0; s < SQUARE_N; ++s)
+        w.gradient[s] = 0.25 * (s % 4);     // the same on every row
+
+    Eval::Weights saved_weights = Eval::weights;
+    Eval::Precision saved = Eval::precision;
+    Eval::set_precision(Eval::DOUBLE);
+
+    bool passed = true;
+    for (int weights = 0; weights < 2 && passed; ++weights) {
+        Eval::init(weights ? w : Eval::Default);
+
+        Bitboard boards[1000];
+        double values[1000];
+        for (int i = 0; i < 1000; ++i) {
+            boards[i] = Random::board() & Random::board();
+            values[i] = Eval::evaluate(boards[i]);
+        }
+
+        for (Eval::Precision p: {Eval::FLOAT, Eval::FIXED}) {
+            Eval::set_precision(p);
+            passed = passed && (!weights || Eval::table_bytes() == 2 * UNIQUE_ROWS * 4);
+
+            for (int i = 0; i < 1000 && passed; ++i)
+                passed = std::abs(Eval::evaluate(boards[i]) - values[i]) <= 1e-3 + 1e-6 * std::abs(values[i]);
+        }
+
+        Eval::set_precision(Eval::DOUBLE);
+    }
+
+    Eval::init(saved_weights);
+    Eval::set_precision(saved);
+    return passed;
+}
+
+
+// Tests that weights loaded from a tuning checkpoint are still in use after the tests that change them
+bool test_loaded_weights() {
+    const char *path = "test_loaded_weights.txt";
+    Eval::Weights saved = Eval::weights;
+
+    {
+        std::ofstream out(path);
+        out << "pass 1\nparam 0\nimproved 0\nobjective 0\nweights";
+        for (int i = 0; i < SQUARE_N; ++i)
+            out << " " << 0.05 * i;
+        out << " 0.02 0.5 10 20 30\nsteps";
+        for (int i = 0; i < SQUARE_N + 5; ++i)
+            out << " 0.1";
+        out << "\n";
+    }
+
+    bool ok = Tune::load(path, Eval::weights);
+    std::remove(path);
+    Eval::init(Eval::weights);
+    uint64_t fingerprint = Eval::fingerprint();
+
+    Bitboard boards[100];
+    double values[100];
+    for (int i = 0; i < 100; ++i) {
+        boards[i] = Random::board() & Random::board();
+        values[i] = Eval::evaluate(boards[i]);
+    }
+
+    ok = ok && test_evaluation() && test_expectation() && test_precision();
+    ok = ok && Eval::fingerprint() == fingerprint;
+    for (int i = 0; i < 100 && ok; ++i)
+        ok = Eval::evaluate(boards[i]) == values[i];
+
+    Eval::init(saved);
+    return ok;
+}
+
+
+// Tests that stored values come back for the same board and depth only
+bool test_transposition_table() {
+    int num_tests = 1000;
+    double value;
+
+    // A table that was never resized misses and stores nothing
+    TranspositionTable empty;
+    empty.clear();
+    if (empty.store(0x1234ULL, 3, 1) || empty.probe(0x1234ULL, 3, value))
+        return false;
+
+    TT.clear();
+    TT.new_search();
+
+    for (int i = 0; i < num_tests; ++i) {
+        Bitboard b = Random::board();
+        TT.store(b, 3, i);
+
+        if (!TT.probe(b, 3, value) || value != i)
+            return false;
+
+        if (!TT.probe(b, 2, value) || TT.probe(b, 4, value))
+            return false;
+    }
+
+    TT.clear();
+    return true;
+}
+
+
+// Tests that all 8 symmetries of a board share one canonical form
+bool test_symmetry() {
+    int num_tests = 10000;
+
+    for (int i = 0; i < num_tests; ++i) {
+        Bitboard b = Random::board();
+        Bitboard t = transpose(b);
+
+        for (Square s = SQ_11; s <= SQ_44; ++s) {
+            Square ts = make_square(Row(s % 4), Col(s / 4));
+            if (get_bits(b, s) != get_bits(t, ts))
+                return false;
+        }
+
+        Bitboard h = flip_horizontal(b);
+        Bitboard v = flip_vertical(b);
+        Bitboard c = canonical(b);
+
+        if (transpose(t) != b || flip_horizontal(h) != b || flip_vertical(v) != b)
+            return false;
+
+        if (canonical(t) != c || canonical(h) != c || canonical(v) != c || canonical(transpose(h)) != c)
+            return false;
+    }
+
+    return true;
+}
+
+
+// Tests the transposed vertical moves against moving each column as a vector
+bool test_vertical_moves() {
     int num_tests = 10000;
 
     for (int i = 0; i < num_tests; ++i) {
         Bitboard b = Random::board();
+        Bitboard up = 0x0ULL;
+        Bitboard down = 0x0ULL;
+
+        for (Col c = COL_1; c <= COL_4; ++c) {
+            Vector v = Bitboards::bitboard_to_vector(get_bits(b, c));
+            Vector vl = Bitboards::move_vector_left(v);
+            Vector vr = Bitboards::move_vector_right(v);
+
+            up |= row_to_col(Bitboards::vector_to_bitboard(vl), c);
+            down |= row_to_col(Bitboards::vector_to_bitboard(vr), c);
+        }
+
+        if (move_up(b) != up || move_down(b) != down)
+            return false;
+
+        MoveList moves(b);
+        for (const PossibleMove &pm: moves) {
+            if (pm.board != make_move(b, pm.move) || pm.board == b)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+
+// Tests that the timed search returns a legal move close to its budget
+bool test_timed_search() {
+    int num_tests = 20;
+    double budget_ms = 10;
+
+    for (int i = 0; i < num_tests; ++i) {
+        Bitboard b = place_random(place_random(place_random(0x0ULL)));
+        for (int m = 0; m < 10 * i && MoveList(b).size() > 0; ++m)
+            b = place_random(make_move(b, MoveList(b)[0].move));
+
+        MoveList moves(b);
+        if (moves.size() == 0)
+            continue;
+
+        double start = omp_get_wtime();
+        Search::Result r = Search::expectimax_timed(b, budget_ms);
+        double ms = 1000 * (omp_get_wtime() - start);
+
+        if (ms > 5 * budget_ms || std::find_if(moves.begin(), moves.end(),
+                [&](const PossibleMove &pm) { return pm.move == r.move; }) == moves.end())
+            return false;
+    }
+
+    return true;
+}
+
+
+// Tests that the deadline of a timed search does not stop a search on another thread
+bool test_timed_search_isolation() {
+    Search::Config saved = Search::config;
+    Search::config.use_tt = false;
+    Search::config.depth = 3;
+
+    Bitboard boards[8];
+    Search::Result expected[8];
+    for (int i = 0; i < 8; ++i) {
+        boards[i] = Random::board() & Random::board() & Random::board();
+        expected[i] = Search::expectimax(boards[i]);
+    }
+
+    std::atomic<bool> done(false);
+    std::thread timed([&] {
+        Bitboard b = 0x0012012512680229ULL;
+        while (!done)
+            Search::expectimax_timed(b, 1);
+    });
+
+    bool ok = true;
+    for (int round = 0; round < 10 && ok; ++round) {
+        for (int i = 0; i < 8 && ok; ++i) {
+            Search::Result r = Search::expectimax(boards[i]);
+            ok = r.move == expected[i].move && r.value == expected[i].value;
+        }
+    }
+
+    done = true;
+    timed.join();
+
+    Search::config = saved;
+    return ok;
+}
+
+
+// Tests that the parallel search counts the same tree as the serial one
+bool test_search_stats() {
+    Search::Config saved = Search::config;
+    Search::config.use_tt = false;
+    Search::config.depth = 2;
+
+    bool ok = true;
+    for (int i = 0; i < 20 && ok; ++i) {
+        Bitboard b = Random::board() & Random::board();
+        if (MoveList(b).size() == 0)
+            continue;
+
+        Search::expectimax(b);
+        Search::Stats serial = Search::stats();
+        Search::expectimax_parallel(b);
+        Search::Stats parallel = Search::stats();
+
+        ok = serial.nodes > 0 && serial.evals > 0 && serial.max_depth <= 2 && serial.depth == 2
+            && serial.nodes == parallel.nodes && serial.evals == parallel.evals
+            && serial.cutoffs == parallel.cutoffs && serial.max_depth == parallel.max_depth;
+    }
+
+    // A reduction larger than the depth left stops at the leaves
+    Search::config.four_reduction = 3;
+    for (int i = 0; i < 20 && ok; ++i) {
+        Search::expectimax(Random::board() & Random::board());
+        ok = Search::stats().max_depth <= 2;
+    }
+
+    Search::config = saved;
+    return ok;
+}
+
+
+// Tests that the bounded search finds the same move and value as the plain one, with fewer nodes,
+// with the default weights and with weights that make evaluations negative
+bool test_bounded_search() {
+    Search::Config saved = Search::config;
+    Eval::Weights saved_weights = Eval::weights;
+    Search::config.use_tt = false;
+    Search::config.depth = 3;
+
+    Eval::Weights w = Eval::Default;
+    w.monotonicity = 0.5;
+    w.smoothness = 200;
+    w.merges = 300;
+    w.empty = 100;
+
+    bool ok = true;
+    uint64_t nodes[2] = {0, 0};
+
+    for (int weights = 0; weights < 2 && ok; ++weights) {
+        Eval::init(weights ? w : Eval::Default);
+
+        for (int i = 0; i < 20 && ok; ++i) {
+            Bitboard b = Random::board() & Random::board() & Random::board();
+            if (MoveList(b).size() == 0)
+                continue;
+
+            Search::config.bounded = false;
+            Search::Result plain = Search::expectimax(b);
+            nodes[0] += Search::stats().nodes;
+
+            Search::config.bounded = true;
+            Search::Result bounded = Search::expectimax(b);
+            nodes[1] += Search::stats().nodes;
+
+            ok = plain.move == bounded.move && std::abs(plain.value - bounded.value) < 1e-6 * std::abs(plain.value);
+        }
+    }
+
+    Eval::init(saved_weights);
+    Search::config = saved;
+    return ok && nodes[1] < nodes[0];
+}
+
+
+// Tests that a batch finds the same moves as searching its boards one by one
+bool test_batch_search() {
+    Search::Config saved = Search::config;
+    Search::config.use_tt = false;
+    Search::config.depth = 3;
+    Search::config.threads = 4;
+
+    std::vector<Bitboard> boards;
+    for (int i = 0; i < 16; ++i)
+        boards.push_back(Random::board() & Random::board() & Random::board());
+
+    std::vector<Search::Result> batch = Search::expectimax_batch(boards.data(), boards.size());
+    uint64_t nodes = Search::stats().nodes;
+
+    bool ok = batch.size() == boards.size();
+    for (size_t i = 0; i < boards.size() && ok; ++i) {
+        Search::Result r = Search::expectimax(boards[i]);
+        ok = r.move == batch[i].move && r.value == batch[i].value;
+        nodes -= Search::stats().nodes;
+    }
+
+    Search::config = saved;
+    return ok && nodes == 0;
+}
+
+
+// Tests that games written to a log read back as the same boards
+bool test_game_log() {
+    const char *path = "test_game_log.bin";
+    std::vector<std::vector<Bitboard>> played;
+
+    GameLog::Writer writer;
+    bool ok = writer.open(path);
+
+    for (uint64_t seed = 1; seed <= 4; ++seed) {
+        Game game(seed);
+        GameLog::Record record;
+        record.begin(seed, game.board());
+        played.push_back({game.board()});
+
+        while (!game.over()) {
+            MoveList possible(game.board());
+            Move m = possible[generator.rand64() % possible.size()].move;
+            Bitboard moved = make_move(game.board(), m);
+
+            game.play(m);
+            record.move(m, moved, game.board());
+            played.back().push_back(game.board());
+        }
+
+        writer.write(record);
+    }
+    ok = ok && writer.good();
+    writer.close();
+
+    GameLog::Reader reader;
+    GameLog::Game game;
+    size_t games = 0;
+    ok = ok && reader.open(path);
+
+    while (ok && reader.next(game)) {
+        const std::vector<Bitboard> &boards = played[games++];
+        Bitboard board = game.start();
+        ok = game.seed == games && (size_t)game.moves() + 1 == boards.size() && board == boards[0];
+
+        for (int i = 0; i < game.moves() && ok; ++i) {
+            uint8_t entry = game.entries[i + 2];
+            board = GameLog::spawn(entry, make_move(board, GameLog::move(entry)));
+            ok = board == boards[i + 1];
+        }
+    }
+
+    std::remove(path);
+    return ok && games == played.size();
+}
+
+
+// Tests that no search allocates once the thread pool is running
+bool test_search_allocations() {
+    Search::Config saved = Search::config;
+    Search::config.depth = 3;
+
+    Bitboard b = 0x0012012512680229ULL;
+    Search::State st(b);
+    Search::expectimax_parallel(b);
+
+    long before = allocations;
+
+    Search::expectimax(b);
+    Search::expectimax_parallel(b);
+    Search::expectimax_timed(b, 5);
+    Search::expected_value(st);
+
+    Search::config = saved;
+    return allocations == before;
+}
+
+
+// Tests that place_random adds a single 2 or 4 on an empty square, 4s about 10% of the time
+bool test_place_random() {
+    int num_tests = 100000;
+    int fours = 0;
+    PRNG rng(1);
+
+    for (int i = 0; i < num_tests; ++i) {
+        Bitboard b = Random::board() & Random::board();     // leave some squares empty
+        Bitboard placed = place_random(b, rng);
+        Bitboard added = placed ^ b;
+
+        if (empty_squares(b) == 0) {
+            if (placed != b)
+                return false;
+            continue;
+        }
+
+        if ((b & added) || empty_squares(placed) != empty_squares(b) - 1)
+            return false;
 
-        Bitboard l = move_left(b);
-        Bitboard r = move_right(b);
+        if (__builtin_popcountll(added) != 1 || (added & 0xCCCCCCCCCCCCCCCCULL))
+            return false;
+
+        fours += (added & 0x2222222222222222ULL) != 0;
+    }
+
+    return fours > num_tests / 12 && fours < num_tests / 8;
+}
+
+
+// Tests the SWAR board kernels against looping over the squares
+bool test_swar_kernels() {
+    int num_tests = 100000;
+    Bitboard expanded[32];
+
+    for (int i = 0; i < num_tests; ++i) {
+        Bitboard b = Random::board() & Random::board();
+        int empty = 0;
+        int max = 0;
+
+        for (Square s = SQ_11; s <= SQ_44; ++s) {
+            empty += get_bits(b, s) == 0;
+            max = std::max(max, bits_to_value(get_bits(b, s)));
+        }
+
+        if (empty_squares(b) != empty || max_value(b) != max)
+            return false;
+
+        if (empty == SQUARE_N)
+            continue;
+
+        Search::expand_inplace(b, expanded);
+        if ((int)expanded[31] != 2 * empty || expanded[2 * empty] != 0)
+            return false;
+
+        for (int j = 0; j < 2 * empty; ++j) {
+            Bitboard added = expanded[j] ^ b;
+            if (!added || (added & b))
+                return false;
+
+            int offset = __builtin_ctzll(added) & ~3;
+            if (added != (Bitboard)(j % 2 ? 2 : 1) << offset)
+                return false;
+        }
     }
 
     return true;
@@ -56,17 +620,31 @@ void run_tests(bool verbose) {
 
     cout << "Runnings tests....." << std::endl;
 
-    auto start = std::clock();
-    bool t1 = test_bitboard_conversion();
-    int c1 = (std::clock() - start) / (double)(CLOCKS_PER_SEC / 1000);
-    string s1 = "test_bitboard_conversion";
-    cout << s1 << pass_string(t1) << "("<< c1 << " ms)" << std::endl;
+    auto run = [&](string name, bool (*test)()) {
+        auto start = std::clock();
+        bool passed = test();
+        int ms = (std::clock() - start) / (double)(CLOCKS_PER_SEC / 1000);
+        cout << name << pass_string(passed) << "("<< ms << " ms)" << std::endl;
+    };
 
-    start = std::clock();
-    bool t5 = time_left_right();
-    int c5 = (std::clock() - start) / (double)(CLOCKS_PER_SEC / 1000);
-    string s5 = "time_left_right";
-    cout << s5 << pass_string(t5) << "("<< c5 << " ms)" << std::endl;
+    run("test_bitboard_conversion", test_bitboard_conversion);
+    run("test_row_tables", test_row_tables);
+    run("test_evaluation", test_evaluation);
+    run("test_expectation", test_expectation);
+    run("test_precision", test_precision);
+    run("test_loaded_weights", test_loaded_weights);
+    run("test_transposition_table", test_transposition_table);
+    run("test_symmetry", test_symmetry);
+    run("test_vertical_moves", test_vertical_moves);
+    run("test_place_random", test_place_random);
+    run("test_swar_kernels", test_swar_kernels);
+    run("test_timed_search", test_timed_search);
+    run("test_timed_search_isolation", test_timed_search_isolation);
+    run("test_search_stats", test_search_stats);
+    run("test_bounded_search", test_bounded_search);
+    run("test_batch_search", test_batch_search);
+    run("test_game_log", test_game_log);
+    run("test_search_allocations", test_search_allocations);
 }
 
 
@@ -116,9 +694,106 @@ void play() {
 }
 
 
-int main() {
-    Bitboards::init();
-    Search::init();
+int main(int argc, char *argv[]) {
+    if (getenv("EVAL_WEIGHTS") && !Tune::load(getenv("EVAL_WEIGHTS"), Eval::weights))
+        std::cerr << "Could not read weights from " << getenv("EVAL_WEIGHTS") << std::endl;
+
+    Tables::init(getenv("TABLES_CACHE"));
+
+    if (getenv("NTUPLE_WEIGHTS")) {
+        if (NTuple::network.load(getenv("NTUPLE_WEIGHTS")))
+            Search::config.evaluator = NTuple::evaluate;
+        else
+            std::cerr << "Could not read n-tuple weights from " << getenv("NTUPLE_WEIGHTS") << std::endl;
+    }
+    TT.resize(64);
+
+    if (getenv("EVAL_PRECISION")) {
+        std::string precision = getenv("EVAL_PRECISION");
+        Eval::set_precision(precision == "float" ? Eval::FLOAT : precision == "fixed" ? Eval::FIXED : Eval::DOUBLE);
+    }
+
+    std::ofstream stats_log;
+    if (getenv("SEARCH_STATS")) {
+        stats_log.open(getenv("SEARCH_STATS"));
+        Search::config.stats_log = &stats_log;
+    }
+
+    if (argc > 1 && std::string(argv[1]) == "bench") {
+        benchmark(argc, argv);
+        return 0;
+    }
+
+    // Usage: 2048cpp batch [games] [seed] [threads] [game log]
+    if (argc > 1 && std::string(argv[1]) == "batch") {
+        SelfPlay::Options options;
+        if (argc > 2) options.games = std::stoi(argv[2]);
+        if (argc > 3) options.seed = std::stoull(argv[3]);
+        if (argc > 4) options.threads = std::stoi(argv[4]);
+        if (argc > 5) options.log = argv[5];
+
+        SelfPlay::report(SelfPlay::run(options), std::cout);
+        return 0;
+    }
+
+    // Usage: 2048cpp tune [games] [passes] [checkpoint] [score|2048|4096]
+    if (argc > 1 && std::string(argv[1]) == "tune") {
+        Tune::Options options;
+        if (argc > 2) options.games = std::stoi(argv[2]);
+        if (argc > 3) options.passes = std::stoi(argv[3]);
+        if (argc > 4) options.checkpoint = argv[4];
+        if (argc > 5) {
+            std::string objective = argv[5];
+            options.objective = objective == "2048" ? Tune::REACH_2048
+                              : objective == "4096" ? Tune::REACH_4096 : Tune::MEAN_SCORE;
+        }
+
+        Tune::run(options);
+        return 0;
+    }
+
+    // Usage: 2048cpp train [games] [weights] [threads] [learning rate]
+    if (argc > 1 && std::string(argv[1]) == "train") {
+        NTuple::TrainOptions options;
+        if (argc > 2) options.games = std::stol(argv[2]);
+        if (argc > 3) options.path = argv[3];
+        if (argc > 4) options.threads = std::stoi(argv[4]);
+        if (argc > 5) options.learning_rate = std::stod(argv[5]);
+
+        options.report_every = std::min(options.report_every, options.games);
+        NTuple::train(options);
+        return 0;
+    }
+
+    // Usage: 2048cpp replay <game log> [games]
+    if (argc > 2 && std::string(argv[1]) == "replay") {
+        long diffs = GameLog::replay(argv[2], argc > 3 ? std::stol(argv[3]) : 0, std::cout);
+        if (diffs < 0)
+            std::cerr << "Could not read the game log " << argv[2] << std::endl;
+
+        return diffs ? 1 : 0;
+    }
+
+    // Usage: 2048cpp regress [corpus] [baseline] [threshold %]
+    if (argc > 1 && std::string(argv[1]) == "regress") {
+        Regression::Options options;
+        if (argc > 2) options.corpus = argv[2];
+        if (argc > 3) options.baseline = argv[3];
+        if (argc > 4) options.threshold = std::stod(argv[4]) / 100;
+
+        return Regression::run(options) ? 1 : 0;
+    }
+
+    // Usage: 2048cpp serve [socket] [workers] [threads per search]
+    if (argc > 1 && std::string(argv[1]) == "serve") {
+        Server::Options options;
+        if (argc > 2 && std::string(argv[2]) != "-") options.socket = argv[2];
+        if (argc > 3) options.workers = std::stoi(argv[3]);
+        if (argc > 4) options.threads = std::stoi(argv[4]);
+
+        return Server::run(options);
+    }
+
     run_tests(true);
     play();
 }
\ No newline at end of file
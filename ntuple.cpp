@@ -0,0 +1,314 @@
+#include "ntuple.h"
+
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bitboard.h"
+#include "prng.h"
+#include "omp.h"
+
+using namespace NTuple;
+
+Network NTuple::network;
+
+// Squares of every tuple: a full row plus two squares, and a 2x3 rectangle, each twice
+const int Tuples[TUPLES][TUPLE_SIZE] = {
+    {0, 1, 2, 3, 4, 5},
+    {4, 5, 6, 7, 8, 9},
+    {0, 1, 2, 4, 5, 6},
+    {4, 5, 6, 8, 9, 10}
+};
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t tuples;
+    uint32_t tuple_size;
+    uint8_t squares[TUPLES][TUPLE_SIZE];
+};
+
+const char MAGIC[8] = "2048NTW";
+
+
+// The 8 rotations and reflections of a board
+inline void symmetries(Bitboard b, Bitboard *boards) {
+    Bitboard h = flip_horizontal(b);
+    Bitboard v = flip_vertical(b);
+    Bitboard hv = flip_vertical(h);
+
+    boards[0] = b;
+    boards[1] = h;
+    boards[2] = v;
+    boards[3] = hv;
+    boards[4] = transpose(b);
+    boards[5] = transpose(h);
+    boards[6] = transpose(v);
+    boards[7] = transpose(hv);
+}
+
+
+inline size_t tuple_index(Bitboard b, int t) {
+    size_t index = 0;
+    for (int k = 0; k < TUPLE_SIZE; ++k)
+        index |= ((b >> (4 * Tuples[t][k])) & 0xF) << (4 * k);
+
+    return (size_t) t * TUPLE_ENTRIES + index;
+}
+
+
+Network::~Network() {
+    release();
+}
+
+
+void Network::release() {
+    if (map)
+        munmap(map, map_size);
+
+    map = nullptr;
+    weights = nullptr;
+    owned.clear();
+    owned.shrink_to_fit();
+}
+
+
+// Start from an untrained network with all weights zero
+void Network::clear() {
+    release();
+    owned.assign((size_t) TUPLES * TUPLE_ENTRIES, 0.0f);
+    weights = owned.data();
+}
+
+
+/*
+    Map a weight file. The mapping is private, so training on a loaded
+    network changes the weights in memory only, until it is saved.
+*/
+bool Network::load(const std::string &path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    size_t size = sizeof(Header) + (size_t) TUPLES * TUPLE_ENTRIES * sizeof(float);
+
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size != size) {
+        close(fd);
+        return false;
+    }
+
+    void *m = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (m == MAP_FAILED)
+        return false;
+
+    const Header *header = (const Header*) m;
+    bool valid = std::memcmp(header->magic, MAGIC, sizeof(MAGIC)) == 0
+              && header->version == VERSION
+              && header->tuples == TUPLES
+              && header->tuple_size == TUPLE_SIZE;
+
+    for (int t = 0; t < TUPLES; ++t)
+        for (int k = 0; k < TUPLE_SIZE; ++k)
+            valid = valid && header->squares[t][k] == Tuples[t][k];
+
+    if (!valid) {
+        munmap(m, size);
+        return false;
+    }
+
+    release();
+    map = m;
+    map_size = size;
+    weights = (float*)((char*) m + sizeof(Header));
+    return true;
+}
+
+
+bool Network::save(const std::string &path) const {
+    if (!weights)
+        return false;
+
+    Header header = {};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.tuples = TUPLES;
+    header.tuple_size = TUPLE_SIZE;
+
+    for (int t = 0; t < TUPLES; ++t)
+        for (int k = 0; k < TUPLE_SIZE; ++k)
+            header.squares[t][k] = Tuples[t][k];
+
+    std::string tmp = path + "." + std::to_string(getpid());
+    FILE *f = fopen(tmp.c_str(), "wb");
+    if (!f)
+        return false;
+
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1
+           && fwrite(weights, sizeof(float), (size_t) TUPLES * TUPLE_ENTRIES, f) == (size_t) TUPLES * TUPLE_ENTRIES;
+
+    ok = (fclose(f) == 0) && ok;
+
+    if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+        remove(tmp.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+
+double Network::value(Bitboard afterstate) const {
+    Bitboard boards[8];
+    symmetries(afterstate, boards);
+
+    double sum = 0;
+    for (Bitboard b: boards)
+        for (int t = 0; t < TUPLES; ++t)
+            sum += weights[tuple_index(b, t)];
+
+    return sum;
+}
+
+
+// Spread delta evenly over the weights that make up the value of the afterstate
+void Network::update(Bitboard afterstate, double delta) {
+    Bitboard boards[8];
+    symmetries(afterstate, boards);
+
+    float step = delta / FEATURES;
+    for (Bitboard b: boards)
+        for (int t = 0; t < TUPLES; ++t)
+            weights[tuple_index(b, t)] += step;
+}
+
+
+/*
+    Value of a board for the search: the score so far plus the best move's
+    reward and afterstate value. Adding the score makes leaves comparable
+    when the paths to them merged different tiles. A board without moves
+    is worth 0, as in the search.
+*/
+double NTuple::evaluate(Bitboard b) {
+    MoveList possible(b);
+
+    if (possible.size() == 0)
+        return 0.0;
+
+    double best = std::numeric_limits<double>::lowest();
+    int current = score(b);
+
+    for (const PossibleMove &pm: possible)
+        best = std::max(best, score(pm.board) - current + network.value(pm.board));
+
+    return current + best;
+}
+
+
+/*
+    Play one game greedily on reward plus afterstate value, and after every
+    move pull the value of the previous afterstate towards the reward of the
+    move plus the value of the new afterstate. Returns the number of moves.
+*/
+int train_game(PRNG &rng, double alpha, Bitboard &final) {
+    Bitboard board = place_random(place_random(0x0ULL, rng), rng);
+    Bitboard prev = 0x0ULL;
+    int moves = 0;
+
+    while (true) {
+        int current = score(board);
+        double best_value = 0;
+        Bitboard best_after = 0x0ULL;
+        int best_reward = 0;
+
+        for (const PossibleMove &pm: MoveList(board)) {
+            int reward = score(pm.board) - current;
+            double value = reward + network.value(pm.board);
+
+            if (!best_after || value > best_value) {
+                best_value = value;
+                best_after = pm.board;
+                best_reward = reward;
+            }
+        }
+
+        if (prev) {
+            double target = best_after ? best_reward + network.value(best_after) : 0.0;
+            network.update(prev, alpha * (target - network.value(prev)));
+        }
+
+        if (!best_after)
+            break;
+
+        prev = best_after;
+        board = place_random(best_after, rng);
+        ++moves;
+    }
+
+    final = board;
+    return moves;
+}
+
+
+/*
+    Games are played in parallel, all updating the one network without
+    locking (Hogwild). Updates racing on the same weight are rare and
+    losing one of them does not hurt training.
+*/
+void NTuple::train(const TrainOptions &options) {
+    if (network.load(options.path))
+        std::cout << "continuing from " << options.path << std::endl;
+    else
+        network.clear();
+
+    int threads = options.threads ? options.threads : omp_get_max_threads();
+
+    for (long first = 0; first < options.games; first += options.report_every) {
+        long last = std::min(options.games, first + options.report_every);
+        long moves = 0;
+        double total_score = 0;
+        int reached[3] = {0, 0, 0};
+        double start = omp_get_wtime();
+
+        #pragma omp parallel for num_threads(threads) schedule(dynamic, 16) reduction(+:moves, total_score)
+        for (long g = first; g < last; ++g) {
+            PRNG rng(options.seed + g);
+            Bitboard final;
+            moves += train_game(rng, options.learning_rate, final);
+            total_score += score(final);
+
+            for (int t = 0; t < 3; ++t) {
+                if (max_value(final) >= (2048 << t)) {
+                    #pragma omp atomic
+                    ++reached[t];
+                }
+            }
+        }
+
+        double seconds = omp_get_wtime() - start;
+        long games = last - first;
+
+        std::cout << "games " << last
+                  << "  score " << (int)(total_score / games)
+                  << std::fixed << std::setprecision(1)
+                  << "  2048 " << 100.0 * reached[0] / games << "%"
+                  << "  4096 " << 100.0 * reached[1] / games << "%"
+                  << "  8192 " << 100.0 * reached[2] / games << "%"
+                  << std::setprecision(0)
+                  << "  games/s " << games / seconds
+                  << "  moves/s " << moves / seconds
+                  << std::defaultfloat << std::endl;
+
+        if (!network.save(options.path))
+            std::cerr << "Failed to save " << options.path << std::endl;
+    }
+}
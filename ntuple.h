@@ -0,0 +1,70 @@
+#ifndef NTUPLE_H_INCLUDED
+#define NTUPLE_H_INCLUDED
+
+#include <string>
+#include <vector>
+
+#include "types.h"
+
+/*
+    Learned evaluation: an n-tuple network over the afterstates of the game,
+    that is boards after a move and before the new tile is placed.
+
+    Each tuple is a fixed set of squares whose ranks index a table of
+    weights, and the value of a board is the sum over all tuples, each
+    sampled in all 8 symmetries of the board. Weights are trained with
+    TD(0) on afterstates from self-play.
+
+    Weight file layout: a Header followed by the TUPLES weight tables of
+    TUPLE_ENTRIES floats each, so the file can be mapped directly.
+*/
+namespace NTuple {
+
+    const int TUPLES = 4;
+    const int TUPLE_SIZE = 6;
+    const int TUPLE_ENTRIES = 1 << (4 * TUPLE_SIZE);
+    const int FEATURES = 8 * TUPLES;       // weights summed per board
+
+    const unsigned int VERSION = 1;
+
+    class Network {
+    public:
+        Network() = default;
+        Network(const Network&) = delete;
+        Network &operator=(const Network&) = delete;
+        ~Network();
+
+        void clear();
+        bool load(const std::string &path);
+        bool save(const std::string &path) const;
+        bool ready() const { return weights != nullptr; }
+
+        double value(Bitboard afterstate) const;
+        void update(Bitboard afterstate, double delta);
+
+    private:
+        void release();
+
+        float *weights = nullptr;
+        std::vector<float> owned;
+        void *map = nullptr;
+        size_t map_size = 0;
+    };
+
+    extern Network network;
+
+    double evaluate(Bitboard b);
+
+    struct TrainOptions {
+        long games = 100000;
+        std::string path = "ntuple.bin";    // loaded if present, saved as training goes
+        uint64_t seed = 1;
+        int threads = 0;                    // 0 for all
+        double learning_rate = 0.1;
+        long report_every = 10000;          // games between progress reports and saves
+    };
+
+    void train(const TrainOptions &options);
+}
+
+#endif
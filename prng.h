@@ -0,0 +1,52 @@
+#ifndef PRNG_H_INCLUDED
+#define PRNG_H_INCLUDED
+
+#include <cstdint>
+
+
+/*
+    xoshiro256** pseudo random generator, seeded through splitmix64.
+    Small enough to keep one per game and much faster than the
+    standard library engines.
+*/
+class PRNG {
+public:
+    explicit PRNG(uint64_t seed = 1) { this->seed(seed); }
+
+    void seed(uint64_t seed) {
+        for (int i = 0; i < 4; ++i) {
+            uint64_t z = (seed += 0x9E3779B97F4A7C15ULL);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+            s[i] = z ^ (z >> 31);
+        }
+    }
+
+    uint64_t rand64() {
+        uint64_t result = rotl(s[1] * 5, 7) * 9;
+        uint64_t t = s[1] << 17;
+
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = rotl(s[3], 45);
+
+        return result;
+    }
+
+    // Uniform in [0, n), by scaling the top 32 bits instead of a division
+    uint32_t below(uint32_t n) {
+        return (uint32_t)(((rand64() >> 32) * n) >> 32);
+    }
+
+private:
+    static uint64_t rotl(uint64_t x, int k) {
+        return (x << k) | (x >> (64 - k));
+    }
+
+    uint64_t s[4];
+};
+
+#endif
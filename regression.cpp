@@ -0,0 +1,242 @@
+#include "regression.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#include <sys/stat.h>
+
+#include "bitboard.h"
+#include "search.h"
+#include "tt.h"
+#include "omp.h"
+
+using namespace Regression;
+
+
+Move parse_move(const std::string &name) {
+    for (Move m = LEFT; m <= RIGHT; ++m)
+        if (Bitboards::pretty(m) == name)
+            return m;
+
+    return NULL_MOVE;
+}
+
+
+/*
+    Read a corpus file: a board in hex and a label per line. Empty lines
+    and lines starting with # are skipped.
+*/
+bool Regression::load_corpus(const std::string &path, std::vector<Position> &positions) {
+    std::ifstream in(path);
+    if (!in)
+        return false;
+
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        std::stringstream ss(line);
+        Position p;
+
+        if (!(ss >> std::hex >> p.board))
+            return false;
+        ss >> p.label;
+
+        positions.push_back(p);
+    }
+
+    return true;
+}
+
+
+Regression::LoadStatus Regression::load(const std::string &path, std::vector<Measurement> &results, int &line) {
+    line = 0;
+
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0 && errno == ENOENT)
+        return MISSING;
+
+    std::ifstream in(path);
+    if (!in)
+        return MALFORMED;
+
+    std::string text;
+    while (std::getline(in, text)) {
+        ++line;
+        if (text.empty())
+            continue;
+
+        std::stringstream ss(text);
+        Measurement m;
+        std::string move, parallel_move;
+
+        if (!(ss >> std::hex >> m.board >> std::dec >> m.label >> move >> parallel_move
+                 >> m.ms >> m.parallel_ms >> m.nodes_per_sec))
+            return MALFORMED;
+
+        m.move = parse_move(move);
+        m.parallel_move = parse_move(parallel_move);
+        results.push_back(m);
+    }
+
+    return LOADED;
+}
+
+
+bool Regression::save(const std::string &path, const std::vector<Measurement> &results) {
+    std::ofstream out(path);
+
+    for (const Measurement &m: results) {
+        out << std::hex << std::setw(16) << std::setfill('0') << m.board << std::dec << std::setfill(' ')
+            << " " << m.label << " " << Bitboards::pretty(m.move) << " " << Bitboards::pretty(m.parallel_move)
+            << " " << m.ms << " " << m.parallel_ms << " " << m.nodes_per_sec << std::endl;
+    }
+
+    return bool(out);
+}
+
+
+/*
+    Search every position repeat times with each search function, starting
+    from an empty table with a fixed depth, and keep the fastest time. The
+    table is cleared outside the timed part, as clearing it costs more than
+    a whole search of most positions.
+*/
+std::vector<Measurement> Regression::measure(const std::vector<Position> &positions, const Options &options) {
+    Search::Config saved = Search::config;
+    Search::config.depth_policy = Search::fixed_depth;
+    Search::config.depth = options.depth;
+    Search::config.clear_tt = false;
+    Search::config.stats_log = nullptr;
+
+    std::vector<Measurement> results;
+
+    for (const Position &p: positions) {
+        Measurement m = {p.board, p.label, NULL_MOVE, NULL_MOVE, 1e30, 1e30, 0};
+
+        for (int i = 0; i < options.repeat; ++i) {
+            TT.clear();
+            double start = omp_get_wtime();
+            m.move = Search::expectimax(p.board).move;
+            double ms = 1000 * (omp_get_wtime() - start);
+
+            if (ms < m.ms) {
+                m.ms = ms;
+                m.nodes_per_sec = Search::stats().nodes / (ms / 1000);
+            }
+
+            TT.clear();
+            start = omp_get_wtime();
+            m.parallel_move = Search::expectimax_parallel(p.board).move;
+            m.parallel_ms = std::min(m.parallel_ms, 1000 * (omp_get_wtime() - start));
+        }
+
+        results.push_back(m);
+    }
+
+    Search::config = saved;
+    return results;
+}
+
+
+int Regression::report(const std::vector<Measurement> &results, const std::vector<Measurement> &baseline,
+                       double threshold, std::ostream &out) {
+    int regressions = 0;
+    double total = 0, parallel_total = 0, base_total = 0, base_parallel_total = 0;
+
+    out << std::setw(8) << "label" << std::setw(18) << "board" << std::setw(10) << "ms"
+        << std::setw(10) << "par ms" << std::setw(10) << "Mnodes/s" << std::setw(7) << "move"
+        << std::setw(10) << "base ms" << std::setw(8) << "change" << "  flags" << std::endl;
+
+    for (const Measurement &m: results) {
+        auto base = std::find_if(baseline.begin(), baseline.end(),
+                [&](const Measurement &b) { return b.board == m.board; });
+
+        out << std::setw(8) << m.label
+            << "  " << std::hex << std::setw(16) << std::setfill('0') << m.board << std::dec << std::setfill(' ')
+            << std::fixed << std::setprecision(2)
+            << std::setw(10) << m.ms << std::setw(10) << m.parallel_ms
+            << std::setw(10) << m.nodes_per_sec / 1e6
+            << std::setw(7) << Bitboards::pretty(m.move);
+
+        total += m.ms;
+        parallel_total += m.parallel_ms;
+
+        if (base == baseline.end()) {
+            out << std::setw(10) << "-" << std::setw(8) << "-" << "  new" << std::defaultfloat << std::endl;
+            continue;
+        }
+
+        base_total += base->ms;
+        base_parallel_total += base->parallel_ms;
+
+        std::string flags;
+        if (m.move != base->move || m.parallel_move != base->parallel_move)
+            flags += " move";
+        if (m.ms > (1 + threshold) * base->ms)
+            flags += " slower";
+        if (m.parallel_ms > (1 + threshold) * base->parallel_ms)
+            flags += " parallel-slower";
+
+        regressions += !flags.empty();
+
+        out << std::setw(10) << base->ms
+            << std::setw(7) << std::setprecision(0) << 100 * (m.ms / base->ms - 1) << "%"
+            << std::setprecision(2) << " " << flags << std::defaultfloat << std::endl;
+    }
+
+    out << std::fixed << std::setprecision(2) << "total: " << total << " ms, parallel " << parallel_total << " ms";
+    if (base_total > 0)
+        out << " (baseline " << base_total << " ms, parallel " << base_parallel_total << " ms)";
+    out << std::defaultfloat << std::endl;
+    out << "regressions: " << regressions << std::endl;
+
+    return regressions;
+}
+
+
+/*
+    Measure the corpus and compare with the baseline. Without a baseline
+    file the results become the baseline. A baseline that can not be read
+    is left alone. Returns the number of regressions, or -1 if the corpus
+    or the baseline could not be read.
+*/
+int Regression::run(const Options &options) {
+    std::vector<Position> positions;
+    if (!load_corpus(options.corpus, positions) || positions.empty()) {
+        std::cerr << "Could not read positions from " << options.corpus << std::endl;
+        return -1;
+    }
+
+    std::vector<Measurement> baseline;
+    int line;
+    LoadStatus status = load(options.baseline, baseline, line);
+
+    if (status == MALFORMED) {
+        std::cerr << "Could not read the baseline " << options.baseline;
+        if (line)
+            std::cerr << ", line " << line;
+        std::cerr << std::endl;
+        return -1;
+    }
+
+    std::vector<Measurement> results = measure(positions, options);
+
+    if (status == MISSING) {
+        report(results, baseline, options.threshold, std::cout);
+
+        if (save(options.baseline, results))
+            std::cout << "Wrote baseline to " << options.baseline << std::endl;
+        else
+            std::cerr << "Could not write baseline to " << options.baseline << std::endl;
+
+        return 0;
+    }
+
+    return report(results, baseline, options.threshold, std::cout);
+}
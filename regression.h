@@ -0,0 +1,61 @@
+#ifndef REGRESSION_H_INCLUDED
+#define REGRESSION_H_INCLUDED
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "types.h"
+
+/*
+    Search latency on a fixed corpus of positions. Every position is searched
+    with expectimax and expectimax_parallel at fixed settings, and the results
+    are compared against a baseline written by an earlier run, flagging
+    changed moves and slowdowns.
+*/
+namespace Regression {
+
+    struct Position {
+        Bitboard board;
+        std::string label;
+    };
+
+    struct Measurement {
+        Bitboard board;
+        std::string label;
+        Move move;              // chosen by expectimax
+        Move parallel_move;     // chosen by expectimax_parallel
+        double ms;              // fastest of the repetitions
+        double parallel_ms;
+        double nodes_per_sec;   // of expectimax
+    };
+
+    struct Options {
+        std::string corpus = "corpus.txt";
+        std::string baseline = "baseline.txt";  // written if it does not exist yet
+        double threshold = 0.2;                 // relative slowdown that is flagged
+        int repeat = 5;                         // searches per position, the fastest counts
+        int depth = 5;
+    };
+
+    enum LoadStatus {
+        LOADED,
+        MISSING,        // no such file
+        MALFORMED       // a line could not be parsed, or the file could not be read
+    };
+
+    bool load_corpus(const std::string &path, std::vector<Position> &positions);
+    // On MALFORMED, line is the number of the bad line, 0 if the file could not be read
+    LoadStatus load(const std::string &path, std::vector<Measurement> &results, int &line);
+    bool save(const std::string &path, const std::vector<Measurement> &results);
+
+    std::vector<Measurement> measure(const std::vector<Position> &positions, const Options &options);
+
+    // Print the results and return the number of regressions
+    int report(const std::vector<Measurement> &results, const std::vector<Measurement> &baseline,
+               double threshold, std::ostream &out);
+
+    int run(const Options &options);
+}
+
+#endif
@@ -4,61 +4,60 @@
 #include <algorithm>
 #include "types.h"
 #include "bitboard.h"
+#include "tt.h"
+#include "eval.h"
 #include <utility>
 #include <limits>
-
-const double DiagLinGrad[SQUARE_N] = {
-    1.00, 0.83, 0.66, 0.50,
-    0.84, 0.67, 0.51, 0.33,
-    0.68, 0.52, 0.34, 0.17,
-    0.53, 0.35, 0.18, 0.00
-};
-
-const double StepGrad[SQUARE_N] = {
-    15, 14 ,13 , 12,
-     8,  9, 10,  11,
-     7,  6,  5,   4,
-     0,  1,  2,   3
- };
-
-double RowValue[SHIFTED_ROWS];
+#include <atomic>
+#include <chrono>
+#include <ostream>
+#include <iomanip>
+#include "omp.h"
 
 const int MAX_DEPTH = 4;
-const double PROBABILITY_CUTOFF = 0.001;
 
-int evaluation_count = 0;
-int probability_cutoffs = 0;
+// Iterative deepening stops here even if there is time left
+const int MAX_TIMED_DEPTH = 12;
+// Rough cost of an iteration relative to the one before it
+const double ITERATION_GROWTH = 4.0;
 
 using namespace Search;
 
-void Search::init() {
+Config Search::config;
 
-    for (Bitboard b = 0x0ULL; b < UNIQUE_ROWS; ++b) {
-        int empty = empty_squares(b) - 12;
-        double empty_score = 1.0 + 1.0*empty/100;
+// Set for the threads of a parallel search, which may split chance nodes into tasks
+thread_local bool spawn_tasks = false;
 
-        // set up row values
-        for (Row r = ROW_1; r <= ROW_4; ++r) {
-            Bitboard row = b << RowOffset[r];
+// Transposition table used by searches started on this thread
+thread_local TranspositionTable *table = &TT;
 
-            double value = 0;
-            for (Square s = SQ_11; s <= SQ_44; ++s)
-                value += DiagLinGrad[s] * DiagLinGrad[s] * bits_to_value(get_bits(row, s)) * empty_score;
+// Counters of the search running on this thread, and the merged
+// counters of the last search started on it
+thread_local Stats thread_stats;
+thread_local Stats last_stats;
 
-            RowValue[UNIQUE_ROWS * r + b] = value;
-        }
-    }
-}
+// Depth of the iteration being searched, to tell how far from the root a node is
+thread_local int root_depth = 0;
 
-double gradient_value_map(Bitboard board) {
-    double value = 0;
-    for (Row r = ROW_1; r <= ROW_4; ++r) {
-        value += RowValue[UNIQUE_ROWS * r + get_bits(board, r)];
-    }
+// Whether the search running on this thread is bounded, and the highest
+// value a node can take within it
+thread_local bool bounded = false;
+thread_local double eval_upper = 0;
 
-    return value;
+// Deadline of the timed search running on this thread. Once it has passed, the
+// stop flag of that search is raised and every remaining node returns at once.
+// The threads of a parallel search share the flag of the thread that started it.
+typedef std::chrono::steady_clock Clock;
+std::atomic<bool> never_stop(false);
+thread_local bool timed = false;
+thread_local Clock::time_point deadline;
+thread_local std::atomic<bool> *stop = &never_stop;
+
+void Search::init(bool row_tables) {
+    Eval::init(Eval::weights, row_tables);
 }
 
+
 std::vector<Expansion> Search::expand_board(Bitboard b) {
     std::vector<Expansion> expanded;
     expanded.reserve(32); // Doing this reserve halves the running time!
@@ -77,58 +76,215 @@ std::vector<Expansion> Search::expand_board(Bitboard b) {
 }
 
 
-void expand_inplace(Bitboard b, Bitboard *expanded) {
+/*
+    Write the boards with a 2 and a 4 added on every empty square to expanded,
+    followed by a zero. expanded[31] holds the number of boards written.
+*/
+void Search::expand_inplace(Bitboard b, Bitboard *expanded) {
     int i = 0;
-    for (Square s = SQ_11; s <= SQ_44; ++s) {
-        if (!(b & SquareMask[s])) { 
-            expanded[i++] = b | (0x1ULL << SquareOffset[s]);    // Set a 2 in the empty square (probability 0.9)
-            expanded[i++] = b | (0x2ULL << SquareOffset[s]);    // Set a 4 in the empty square (probability 0.1)
-        }
+    for (Bitboard empty = empty_mask(b); empty; empty &= empty - 1) {
+        Bitboard square = empty & -empty;
+        expanded[i++] = b | square;         // Set a 2 in the empty square (probability 0.9)
+        expanded[i++] = b | (square << 1);  // Set a 4 in the empty square (probability 0.1)
     }
     expanded[i] = 0;    // make sure to set zero to indicate end
     expanded[31] = i;   // indicate how many were empty
 }
 
-double gradient_value(Bitboard b) {
-    double sum = 0;
+/*
+    Value of the board in its best orientation. This makes the evaluation,
+    and therefore the whole search, invariant under the 8 board symmetries.
+*/
+double symmetric_value(Bitboard b) {
+    Bitboard h = flip_horizontal(b);
+    Bitboard v = flip_vertical(b);
+    Bitboard hv = flip_vertical(h);
+    Bitboard boards[8] = {b, h, v, hv, transpose(b), transpose(h), transpose(v), transpose(hv)};
 
-    for (Square s = SQ_11; s <= SQ_44; ++s) {
-        sum += DiagLinGrad[s]*DiagLinGrad[s]*bits_to_value(get_bits(b, s));
-    }
+    double max = std::numeric_limits<double>::lowest();
+    for (Bitboard sb: boards)
+        max = std::max(max, config.evaluator(sb));
 
-    return sum;
+    return max;
 }
 
 
 double Search::evaluate(Bitboard b) {
-    return gradient_value_map(b);
+    ++thread_stats.evals;
+
+    return config.symmetric ? symmetric_value(b) : config.evaluator(b);
 }
 
 
-double Search::_value_expected_node(Bitboard board, int depth, double prob) {   
+/*
+    Set up a search of the moves of board to depth. A move raises the largest
+    tile by at most one rank and new tiles are at most a 4, which limits the
+    ranks within the search and so bounds the evaluation of a bounded search.
+    Game over is worth 0. Only the tables of Eval::evaluate give such a bound.
+*/
+void set_root(Bitboard board, int depth) {
+    root_depth = depth;
+    bounded = config.bounded && config.evaluator == Eval::evaluate;
+
+    if (bounded)
+        eval_upper = std::max(0.0, Eval::upper_bound(std::max(max_rank(board), 2) + depth));
+}
+
+
+/*
+    Keep count of the n/2 empty squares in expanded, spread evenly over
+    the board, moving them to the front. Returns the new number of boards.
+*/
+int sample_squares(Bitboard *expanded, int n, int count) {
+    int squares = n / 2;
+
+    for (int i = 0; i < count; ++i) {
+        int sq = i * squares / count;
+        expanded[2*i] = expanded[2*sq];
+        expanded[2*i+1] = expanded[2*sq+1];
+    }
+
+    expanded[2*count] = 0;
+    return 2*count;
+}
+
+
+/*
+    Depth is the remaining search depth, so that values stored in the
+    transposition table can be reused wherever the same board is reached
+    with at most as much depth left.
+
+    Chance nodes can be reduced in three ways, see Config: the boards with a
+    4 are searched less deeply, only some of the empty squares of an open
+    board are searched, and a chance node reached with too little
+    probability is evaluated before any tile is placed.
+
+    A bounded search (Star1) stops searching a chance node once it can no
+    longer get above alpha, the best value of its siblings, even if all
+    remaining children took the highest possible value. It then returns
+    that upper bound instead of the exact value. All the boards with a 2,
+    which carry 90% of the probability, are searched before the boards
+    with a 4, so the bound comes down as fast as possible.
+*/
+double Search::_value_expected_node(Bitboard board, int depth, double prob, double alpha) {
+    double expected_value = 0;
+    Bitboard key = config.symmetric ? canonical(board) : board;
+
+    if (prob < config.chance_cutoff) {
+        ++thread_stats.cutoffs;
+        return evaluate(board);
+    }
+
+    if (config.use_tt) {
+        bool upper = false;
+
+        if (table->probe(key, depth, expected_value, upper) && (!upper || expected_value <= alpha)) {
+            ++thread_stats.tt_hits;
+            return expected_value;
+        }
+        ++thread_stats.tt_misses;
+        expected_value = 0;
+    }
+
+    ++thread_stats.nodes;
+
     Bitboard expanded[32];
     expand_inplace(board, expanded);
 
-    double expected_value = 0;
-    double prob_sum = (double)expanded[31]/2.0;
+    int n = expanded[31];
+    if (config.sample_squares && n > 2 * config.sample_squares)
+        n = sample_squares(expanded, n, config.sample_squares);
+
+    double prob_sum = (double)n/2.0;
     double prob2 = 0.9/prob_sum;
     double prob4 = 0.1/prob_sum;
+    int depth4 = std::max(0, depth - 1 - config.four_reduction);
+
+    if (depth <= 1 && config.evaluator == Eval::evaluate && !config.symmetric && !bounded) {
+        // Every child is a leaf: evaluate them all in one batch
+        thread_stats.evals += n;
+        thread_stats.max_depth = std::max(thread_stats.max_depth, root_depth);
+        expected_value = Eval::expectation(expanded, n, prob2, prob4);
+    }
+    else if (spawn_tasks && depth >= config.task_depth) {
+        // Hand every child to the thread pool; idle threads steal them
+        double values[32];
+
+        for (int i = 0; i < n; ++i) {
+            #pragma omp task firstprivate(i) shared(values, expanded)
+            values[i] = i % 2 ? _value_max_node(expanded[i], depth4, prob*prob4)
+                              : _value_max_node(expanded[i], depth-1, prob*prob2);
+        }
+        #pragma omp taskwait
+
+        for (int i = 0; i < n; i += 2)
+            expected_value += prob2*values[i] + prob4*values[i+1];
+    }
+    else if (bounded) {
+        double rest = 1.0;  // probability of the children not searched yet
+
+        for (int four = 0; four < 2; ++four) {
+            double p = four ? prob4 : prob2;
+            int child_depth = four ? depth4 : depth-1;
+
+            for (int i = four; i < n; i += 2) {
+                rest -= p;
+                double child_alpha = (alpha - expected_value - rest*eval_upper) / p;
+                expected_value += p*_value_max_node(expanded[i], child_depth, prob*p, child_alpha);
+
+                if (expected_value + rest*eval_upper <= alpha) {
+                    expected_value += rest*eval_upper;
+                    ++thread_stats.bound_cutoffs;
+
+                    if (config.use_tt && !stop->load(std::memory_order_relaxed))
+                        thread_stats.tt_collisions += table->store(key, depth, expected_value, true);
 
-    Bitboard *curr = expanded;
-    while (*curr) {
-        expected_value += prob2*_value_max_node(*(curr++), depth+1, prob*prob2) + 
-                          prob4*_value_max_node(*(curr++), depth+1, prob*prob4);
+                    return expected_value;
+                }
+            }
+        }
+    }
+    else {
+        for (Bitboard *curr = expanded; *curr; curr += 2) {
+            expected_value += prob2*_value_max_node(curr[0], depth-1, prob*prob2) + 
+                              prob4*_value_max_node(curr[1], depth4, prob*prob4);
+        }
     }
 
+    if (config.use_tt && !stop->load(std::memory_order_relaxed))
+        thread_stats.tt_collisions += table->store(key, depth, expected_value);
+
     return expected_value;
 }
 
 
-double Search::_value_max_node(Bitboard board, int depth, double prob) {
-    if (depth >= MAX_DEPTH || prob < PROBABILITY_CUTOFF)
+/*
+    In a bounded search a value at or below alpha is only an upper bound,
+    as the chance nodes below may have stopped early.
+*/
+double Search::_value_max_node(Bitboard board, int depth, double prob, double alpha) {
+    if (stop->load(std::memory_order_relaxed))
+        return 0.0;
+
+    thread_stats.max_depth = std::max(thread_stats.max_depth, root_depth - depth);
+
+    if (depth <= 0)
         return evaluate(board);
 
-    auto possible = possible_moves(board);
+    if (prob < config.prob_cutoff) {
+        ++thread_stats.cutoffs;
+        return evaluate(board);
+    }
+
+    // Only look at the clock where there is a subtree worth abandoning
+    if (timed && depth >= 2 && Clock::now() > deadline) {
+        stop->store(true, std::memory_order_relaxed);
+        return 0.0;
+    }
+
+    ++thread_stats.nodes;
+
+    MoveList possible(board);
 
     if (possible.size() == 0) {
         return 0.0;
@@ -137,107 +293,454 @@ double Search::_value_max_node(Bitboard board, int depth, double prob) {
     double max = std::numeric_limits<double>::lowest();
 
     for (auto it = possible.begin(); it != possible.end(); ++it) {
-        double val = _value_expected_node(it->board, depth, prob);
+        double val = _value_expected_node(it->board, depth, prob, std::max(alpha, max));
         if (val > max) max = val;
     }
 
     return max;
 }
 
-Result Search::expectimax(Bitboard board) {
-    auto possible = possible_moves(board);
 
-    if (possible.size() == 0) {
+/*
+    Use the given table for searches started on the calling thread instead of
+    the global one, e.g. to give every game of a batch its own table.
+*/
+void Search::set_table(TranspositionTable *tt) {
+    table = tt;
+}
+
+
+// Statistics of the last search started on the calling thread
+const Stats &Search::stats() {
+    return last_stats;
+}
+
+
+void Stats::add(const Stats &s) {
+    nodes += s.nodes;
+    evals += s.evals;
+    cutoffs += s.cutoffs;
+    bound_cutoffs += s.bound_cutoffs;
+    tt_hits += s.tt_hits;
+    tt_misses += s.tt_misses;
+    tt_collisions += s.tt_collisions;
+    depth = std::max(depth, s.depth);
+    max_depth = std::max(max_depth, s.max_depth);
+    setup_ms += s.setup_ms;
+    search_ms += s.search_ms;
+    merge_ms += s.merge_ms;
+}
+
+
+int Search::fixed_depth(Bitboard) {
+    return config.depth;
+}
+
+
+/*
+    The number of chance node children is twice the number of empty squares,
+    so open boards are searched shallower and crowded ones deeper. Boards with
+    many different tiles are further from merging and get more depth as well.
+*/
+int Search::adaptive_depth(Bitboard board) {
+    int depth = distinct_tiles(board) - 5;
+    int empty = empty_squares(board);
+
+    if (empty <= 3)
+        ++depth;
+    else if (empty >= 8)
+        --depth;
+
+    return std::max(2, std::min(depth, 6));
+}
+
+
+void new_search() {
+    thread_stats = Stats();
+
+    if (config.clear_tt)
+        table->clear();
+    else
+        table->new_search();
+}
+
+
+// Milliseconds since t, moving t to now
+double lap(Clock::time_point &t) {
+    Clock::time_point now = Clock::now();
+    double ms = std::chrono::duration<double, std::milli>(now - t).count();
+    t = now;
+    return ms;
+}
+
+
+/*
+    Publish the counters of the search that just ended on this thread,
+    and log them as one JSON line if asked to.
+*/
+void end_search(Bitboard board, Result r) {
+    last_stats = thread_stats;
+
+    if (!config.stats_log)
+        return;
+
+    const Stats &s = last_stats;
+
+    #pragma omp critical(stats_log)
+    {
+        std::ostream &out = *config.stats_log;
+        out << "{\"board\":\"" << std::hex << std::setw(16) << std::setfill('0') << board
+            << std::dec << std::setfill(' ') << "\""
+            << ",\"move\":\"" << Bitboards::pretty(r.move) << "\""
+            << ",\"value\":" << r.value
+            << ",\"depth\":" << s.depth
+            << ",\"max_depth\":" << s.max_depth
+            << ",\"nodes\":" << s.nodes
+            << ",\"evals\":" << s.evals
+            << ",\"cutoffs\":" << s.cutoffs
+            << ",\"bound_cutoffs\":" << s.bound_cutoffs
+            << ",\"tt_hits\":" << s.tt_hits
+            << ",\"tt_misses\":" << s.tt_misses
+            << ",\"tt_collisions\":" << s.tt_collisions
+            << ",\"setup_ms\":" << s.setup_ms
+            << ",\"search_ms\":" << s.search_ms
+            << ",\"merge_ms\":" << s.merge_ms << "}\n";
+    }
+}
+
+
+/*
+    Search the root moves one after the other on the calling thread. Searches
+    of a batch share the table aged once for the whole batch, so they only
+    reset their counters.
+*/
+Result serial_search(Bitboard board, bool age_table) {
+    Clock::time_point t = Clock::now();
+    MoveList possible(board);
+    int n = possible.size();
+
+    if (n == 0) {
+        last_stats = Stats();
         return {NULL_MOVE, 0};
     }
 
-    std::map<Move, double> move_values;
+    if (age_table)
+        new_search();
+    else
+        thread_stats = Stats();
+
+    int depth = config.depth_policy(board);
+    double values[MOVE_N];
 
-    for (const PossibleMove & pm: possible) {
-        move_values[pm.move] = _value_expected_node(pm.board, 0, 1);
+    set_root(board, depth);
+    thread_stats.depth = depth;
+    thread_stats.setup_ms = lap(t);
+
+    // Only the best move needs an exact value
+    for (int i = 0; i < n; i++) {
+        double alpha = std::numeric_limits<double>::lowest();
+        for (int j = 0; j < i; j++)
+            alpha = std::max(alpha, values[j]);
+
+        values[i] = _value_expected_node(possible[i].board, depth, 1, alpha);
+    }
+
+    thread_stats.search_ms = lap(t);
+
+    Result best = {possible[0].move, values[0]};
+    for (int i = 1; i < n; i++) {
+        if (values[i] > best.value)
+            best = {possible[i].move, values[i]};
     }
 
-    auto max = std::max_element(move_values.begin(), move_values.end(),
-            [](const std::pair<Move, double>& p1, const std::pair<Move, double>& p2) {
-                return p1.second < p2.second; });
+    thread_stats.merge_ms = lap(t);
+    end_search(board, best);
+
+    return best;
+}
+
+
+Result Search::expectimax(Bitboard board) {
+    return serial_search(board, true);
+}
+
+
+/*
+    Search many independent boards, one board per thread at a time. Threads
+    take the next board as soon as they are done, so boards of different
+    cost balance out, and no search splits into tasks of its own. The stats
+    of the calling thread are the sum over all boards afterwards.
+*/
+std::vector<Result> Search::expectimax_batch(const Bitboard *boards, size_t n) {
+    int threads = config.threads ? config.threads : omp_get_max_threads();
+    TranspositionTable *tt = table;
+    std::vector<Result> results(n);
+    Stats merged;
+
+    if (config.clear_tt)
+        table->clear();
+    else
+        table->new_search();
+
+    #pragma omp parallel num_threads(threads)
+    {
+        table = tt;
+        Stats sum;
+
+        #pragma omp for schedule(dynamic, 1)
+        for (size_t i = 0; i < n; i++) {
+            results[i] = serial_search(boards[i], false);
+            sum.add(last_stats);
+        }
+
+        #pragma omp critical(search_stats)
+        merged.add(sum);
+    }
+
+    last_stats = merged;
+    return results;
+}
+
+/*
+    Search the given root moves to depth in parallel, storing the value
+    of moves[i] in values[i], and in done[i] whether that search finished
+    before a timed search was stopped. The counters of all threads are
+    added to those of the calling thread.
+
+    A bounded search searches moves[0] first and the others against its
+    value, so the best move should come first. The values of the other
+    moves are then only upper bounds where they are not better.
+*/
+void search_root(Bitboard board, const PossibleMove *moves, int n, int depth, double *values, bool *done) {
+    int threads = config.threads ? config.threads : omp_get_max_threads();
+    TranspositionTable *tt = table;
+    bool caller_timed = timed;
+    Clock::time_point caller_deadline = deadline;
+    std::atomic<bool> *caller_stop = stop;
+    Stats caller = thread_stats;
+    Stats merged;
+
+    #pragma omp parallel num_threads(threads)
+    {
+        spawn_tasks = true;
+        table = tt;
+        timed = caller_timed;
+        deadline = caller_deadline;
+        stop = caller_stop;
+        set_root(board, depth);
+        thread_stats = Stats();
+
+        #pragma omp single
+        {
+            int first = 0;
+            double alpha = std::numeric_limits<double>::lowest();
+
+            if (bounded) {
+                values[0] = _value_expected_node(moves[0].board, depth, 1);
+                done[0] = !stop->load(std::memory_order_relaxed);
+                alpha = values[0];
+                first = 1;
+            }
+
+            for (int i = first; i < n; i++) {
+                #pragma omp task firstprivate(i, alpha)
+                {
+                    values[i] = _value_expected_node(moves[i].board, depth, 1, alpha);
+                    done[i] = !stop->load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        spawn_tasks = false;
+        timed = false;
+        stop = &never_stop;
+
+        #pragma omp critical(search_stats)
+        merged.add(thread_stats);
+    }
 
-    return {max->first, max->second};
+    timed = caller_timed;
+    stop = caller_stop;
+    thread_stats = caller;
+    thread_stats.add(merged);
 }
 
+
 Result Search::expectimax_parallel(Bitboard board) {
-    auto possible = possible_moves(board);
+    Clock::time_point t = Clock::now();
+    MoveList possible(board);
     int n = possible.size();
 
     if (n == 0) {
+        last_stats = Stats();
         return {NULL_MOVE, 0};
     }
 
+    new_search();
+
+    int depth = config.depth_policy(board);
     double values[MOVE_N];
-    #pragma omp parallel for num_threads(n)
-    for (int i = 0; i < n; i++) {
-        values[possible[i].move] = _value_expected_node(possible[i].board, 0, 1);
-    }
+    bool done[MOVE_N];
+
+    thread_stats.setup_ms = lap(t);
+    search_root(board, possible.begin(), n, depth, values, done);
+    thread_stats.search_ms = lap(t);
+    thread_stats.depth = depth;
 
     Move best_move = NULL_MOVE;
     double max_value = std::numeric_limits<double>::lowest();
 
-    for (const PossibleMove & pm: possible) {
-        if (values[pm.move] > max_value) {
-            best_move = pm.move;
-            max_value = values[pm.move];
+    for (int i = 0; i < n; i++) {
+        if (values[i] > max_value) {
+            best_move = possible[i].move;
+            max_value = values[i];
         }
     }
 
+    thread_stats.merge_ms = lap(t);
+    end_search(board, {best_move, max_value});
+
     return {best_move, max_value};
 }
 
 
+/*
+    Iterative deepening within a wall clock budget. Every iteration searches
+    the root moves in the order of the values found by the one before, and
+    the result of the deepest completed iteration is returned. The first
+    iteration always completes. No new iteration is started if it is not
+    expected to finish in the time left.
+
+    The order pays off twice. A bounded search searches the other moves
+    against the value of the best one, see search_root. And when the
+    deadline cuts an iteration short after the best move of the last
+    iteration finished, the moves that finished at the new depth are used.
+*/
+Result Search::expectimax_timed(Bitboard board, double budget_ms) {
+    Clock::time_point start = Clock::now();
+    Clock::time_point t = start;
+    MoveList possible(board);
+    int n = possible.size();
+
+    if (n == 0) {
+        last_stats = Stats();
+        return {NULL_MOVE, 0};
+    }
+
+    new_search();
+
+    std::atomic<bool> stopped(false);
+    stop = &stopped;
+    deadline = start + std::chrono::microseconds((long long)(1000 * budget_ms));
+
+    PossibleMove order[MOVE_N];
+    std::copy(possible.begin(), possible.end(), order);
+
+    Result best = {order[0].move, 0};
+    double values[MOVE_N];
+    bool done[MOVE_N];
+    double last_ms = 0;
+
+    thread_stats.setup_ms = lap(t);
+
+    for (int depth = 1; depth <= MAX_TIMED_DEPTH; ++depth) {
+        Clock::time_point iteration_start = Clock::now();
+
+        timed = depth > 1;
+        search_root(board, order, n, depth, values, done);
+        timed = false;
+
+        if (stopped) {
+            if (done[0]) {
+                best = {order[0].move, values[0]};
+                for (int i = 1; i < n; i++) {
+                    if (done[i] && values[i] > best.value)
+                        best = {order[i].move, values[i]};
+                }
+            }
+            break;
+        }
+
+        // Best move first for the next iteration, ties kept in order. Unlike
+        // stable_sort, sort does not allocate a buffer.
+        int idx[MOVE_N] = {0, 1, 2, 3};
+        std::sort(idx, idx + n, [&](int a, int b) {
+            return values[a] > values[b] || (values[a] == values[b] && a < b); });
+
+        PossibleMove sorted[MOVE_N];
+        for (int i = 0; i < n; i++)
+            sorted[i] = order[idx[i]];
+        std::copy(sorted, sorted + n, order);
+
+        best = {order[0].move, values[idx[0]]};
+        thread_stats.depth = depth;
+
+        Clock::time_point now = Clock::now();
+        last_ms = std::chrono::duration<double, std::milli>(now - iteration_start).count();
+        double elapsed_ms = std::chrono::duration<double, std::milli>(now - start).count();
+
+        if (elapsed_ms + ITERATION_GROWTH * last_ms > budget_ms)
+            break;
+    }
+
+    stop = &never_stop;
+
+    // Reordering the root moves is part of every iteration
+    thread_stats.search_ms = lap(t);
+    end_search(board, best);
+
+    return best;
+}
+
+
 Result Search::expected_value(State & st) {
+    thread_stats.max_depth = std::max(thread_stats.max_depth, (int)st.depth);
+
     // First base case: we reached depth
     if (st.depth == MAX_DEPTH) {
         return {NULL_MOVE, evaluate(st.board)};
     }
 
     // Second base case: we are below probablity cutoff
-    if (st.prob < PROBABILITY_CUTOFF) {
-        ++probability_cutoffs;
+    if (st.prob < config.prob_cutoff) {
+        ++thread_stats.cutoffs;
         return {NULL_MOVE, evaluate(st.board)};
     }
 
-    auto possible = possible_moves(st.board);
+    ++thread_stats.nodes;
+
+    MoveList possible(st.board);
 
     // Third base case: there are no possible moves
     if (possible.size() ==  0) {
         return {NULL_MOVE, 0};
     }
 
-
-    std::map<Move, double> move_values;
+    Result best = {NULL_MOVE, std::numeric_limits<double>::lowest()};
     double value = 0;
     double prob_sum = 0;
     double prob = 0;
 
-    for (const PossibleMove pm: possible) { // For each possible move we want to find the expected value
+    for (const PossibleMove & pm: possible) { // For each possible move we want to find the expected value
         value = 0;
 
-        // Expand the board fully to all possible states
-        std::vector<Expansion> expanded = expand_board(pm.board);
-        prob_sum = (double)expanded.size() / 2.0;
+        // Expand the board fully to all possible states, a 2 and then a 4 on every empty square
+        Bitboard expanded[32];
+        expand_inplace(pm.board, expanded);
+        int n = expanded[31];
+        prob_sum = (double)n / 2.0;
 
-        for (const Expansion exp: expanded) {
-            prob = exp.prob/prob_sum;
-            State next_state(exp.board, st.depth+1, st.prob*prob);
+        for (int i = 0; i < n; ++i) {
+            prob = (i % 2 ? 0.1 : 0.9)/prob_sum;
+            State next_state(expanded[i], st.depth+1, st.prob*prob);
 
             Result r = expected_value(next_state);
             value += prob*r.value;
         }
 
-        move_values[pm.move] = value;
+        if (value > best.value)
+            best = {pm.move, value};
     }
 
-    auto max = std::max_element(move_values.begin(), move_values.end(),
-            [](const std::pair<Move, double>& p1, const std::pair<Move, double>& p2) {
-                return p1.second < p2.second; });
-
-    return {max->first, max->second};
+    return best;
 }
@@ -1,11 +1,51 @@
 #ifndef SEARCH_H_INCLUDED
 #define SEARCH_H_INCLUDED
 
+#include <iosfwd>
+#include <limits>
+
 #include "types.h"
+#include "eval.h"
+
+class TranspositionTable;
 
 namespace Search {
 
-    void init();
+    void init(bool row_tables = true);
+    void set_table(TranspositionTable *tt);
+
+    // Picks the search depth for a board
+    typedef int (*DepthPolicy)(Bitboard board);
+
+    int fixed_depth(Bitboard board);
+    int adaptive_depth(Bitboard board);
+
+    // Static value of a board at the search horizon
+    typedef double (*Evaluator)(Bitboard board);
+
+    struct Config {
+        bool use_tt = true;         // cache chance node values in the transposition table
+        bool clear_tt = false;      // clear the table before every search instead of aging it
+        bool symmetric = false;     // evaluate boards independent of orientation and share
+                                    // table entries between symmetric boards
+        int threads = 0;            // threads used by expectimax_parallel, 0 for all
+        int task_depth = 3;         // chance nodes with at least this much depth left
+                                    // split their children into tasks
+        DepthPolicy depth_policy = fixed_depth;
+        int depth = 4;              // depth searched by fixed_depth
+        double prob_cutoff = 0.001; // max nodes reached with less probability are evaluated
+        double chance_cutoff = 0;   // chance nodes reached with less probability are evaluated
+                                    // before a tile is placed instead of being expanded
+        int four_reduction = 0;     // extra depth taken off the boards where a 4 was placed
+        int sample_squares = 0;     // on boards with more empty squares, only search this many
+                                    // of them, spread over the board. 0 searches all of them
+        bool bounded = false;       // skip chance nodes that can not beat a sibling (Star1). Only
+                                    // with Eval::evaluate, other evaluators are searched plainly
+        Evaluator evaluator = Eval::evaluate;
+        std::ostream *stats_log = nullptr;  // write the stats of every search here as a JSON line
+    };
+
+    extern Config config;
 
     struct State {
         Bitboard board;
@@ -21,6 +61,30 @@ namespace Search {
         double value;
     };
 
+    /*
+        Counters of a search. Every thread counts into its own copy, and the
+        copies are merged when the search ends. Phase times are wall clock
+        times measured by the thread that started the search.
+    */
+    struct Stats {
+        uint64_t nodes = 0;         // max and chance nodes
+        uint64_t evals = 0;         // leaves evaluated
+        uint64_t cutoffs = 0;       // nodes cut off by probability
+        uint64_t bound_cutoffs = 0; // chance nodes left early by a bounded search
+        uint64_t tt_hits = 0;
+        uint64_t tt_misses = 0;
+        uint64_t tt_collisions = 0; // stores that evicted an entry for another board
+        int depth = 0;              // depth of the (last completed) iteration
+        int max_depth = 0;          // deepest max node reached, in moves from the root
+        double setup_ms = 0;        // move generation and table aging
+        double search_ms = 0;       // searching the root moves
+        double merge_ms = 0;        // merging thread counters and picking the move
+
+        void add(const Stats &s);
+    };
+
+    const Stats &stats();
+
     struct Expansion {
         Bitboard board;
         double prob;
@@ -29,13 +93,18 @@ namespace Search {
     };
 
     std::vector<Expansion> expand_board(Bitboard b);
+    void expand_inplace(Bitboard b, Bitboard *expanded);
     Result expected_value(State & st);
     double evaluate(Bitboard b);
 
-    double _value_expected_node(Bitboard board, int depth, double prob);
-    double _value_max_node(Bitboard board, int depth, double prob);
+    double _value_expected_node(Bitboard board, int depth, double prob,
+                                double alpha = std::numeric_limits<double>::lowest());
+    double _value_max_node(Bitboard board, int depth, double prob,
+                           double alpha = std::numeric_limits<double>::lowest());
     Result expectimax(Bitboard board);
     Result expectimax_parallel(Bitboard board);
+    std::vector<Result> expectimax_batch(const Bitboard *boards, size_t n);
+    Result expectimax_timed(Bitboard board, double budget_ms);
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,134 @@
+#include "selfplay.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+
+#include "bitboard.h"
+#include "game.h"
+#include "gamelog.h"
+#include "search.h"
+#include "tt.h"
+#include "omp.h"
+
+using namespace SelfPlay;
+
+
+/*
+    Play the games of a batch with one game per thread at a time. Every thread
+    searches with its own transposition table, cleared before each game, so
+    threads never share state and a game only depends on its seed.
+*/
+Batch SelfPlay::run(const Options &options) {
+    Batch batch;
+    batch.games.resize(options.games);
+
+    GameLog::Writer writer;
+    bool logging = !options.log.empty();
+    if (logging && !writer.open(options.log))
+        std::cerr << "Could not write the game log " << options.log << std::endl;
+
+    int threads = options.threads ? options.threads : omp_get_max_threads();
+    double start = omp_get_wtime();
+
+    #pragma omp parallel num_threads(threads)
+    {
+        TranspositionTable tt;
+        tt.resize(options.tt_mb);
+        Search::set_table(&tt);
+        GameLog::Record log;
+
+        #pragma omp for schedule(dynamic, 1)
+        for (int i = 0; i < options.games; ++i) {
+            GameRecord &record = batch.games[i];
+            record.seed = options.seed + i;
+            tt.clear();
+
+            Game game(record.seed);
+            log.begin(record.seed, game.board());
+
+            while (true) {
+                double move_start = omp_get_wtime();
+                Search::Result result = Search::expectimax(game.board());
+                record.move_ms.push_back(1000 * (omp_get_wtime() - move_start));
+                record.stats.add(Search::stats());
+
+                if (result.move == NULL_MOVE)
+                    break;
+
+                Bitboard moved = make_move(game.board(), result.move);
+                game.play(result.move);
+                log.move(result.move, moved, game.board());
+            }
+
+            if (logging) {
+                #pragma omp critical(game_log)
+                writer.write(log);
+            }
+
+            record.board = game.board();
+            record.moves = game.moves();
+            record.score = game.score();
+        }
+
+        Search::set_table(&TT);
+    }
+
+    batch.seconds = omp_get_wtime() - start;
+    return batch;
+}
+
+
+void SelfPlay::report(const Batch &batch, std::ostream &out) {
+    int n = batch.games.size();
+
+    if (n == 0)
+        return;
+
+    std::vector<int> scores;
+    std::vector<float> move_ms;
+    int tiles[SQUARE_N] = {};
+    long moves = 0;
+    Search::Stats stats;
+
+    for (const GameRecord &g: batch.games) {
+        scores.push_back(g.score);
+        move_ms.insert(move_ms.end(), g.move_ms.begin(), g.move_ms.end());
+        moves += g.moves;
+        stats.add(g.stats);
+
+        for (int rank = 1; rank < SQUARE_N; ++rank) {
+            if (max_value(g.board) == bits_to_value(rank))
+                ++tiles[rank];
+        }
+    }
+
+    std::sort(scores.begin(), scores.end());
+    std::sort(move_ms.begin(), move_ms.end());
+
+    double mean = 0;
+    for (int s: scores)
+        mean += (double)s / n;
+
+    auto percentile = [&](double p) { return move_ms[std::min(move_ms.size() - 1, (size_t)(p * move_ms.size()))]; };
+
+    out << "games: " << n << ", moves: " << moves << ", time: " << batch.seconds << " s" << std::endl;
+    out << "moves/sec: " << moves / batch.seconds << std::endl;
+    out << "score: mean " << (int)mean << ", median " << scores[n / 2]
+        << ", min " << scores.front() << ", max " << scores.back() << std::endl;
+    out << "ms/move: p50 " << percentile(0.5) << ", p90 " << percentile(0.9)
+        << ", p99 " << percentile(0.99) << ", max " << move_ms.back() << std::endl;
+    out << "per move: nodes " << stats.nodes / moves << ", evals " << stats.evals / moves
+        << ", cutoffs " << stats.cutoffs / moves << ", tt hit rate "
+        << 100.0 * stats.tt_hits / std::max<uint64_t>(1, stats.tt_hits + stats.tt_misses) << "%" << std::endl;
+    out << "search time: " << 100.0 * stats.search_ms / std::max(1e-9, stats.setup_ms + stats.search_ms + stats.merge_ms)
+        << "% of " << stats.setup_ms + stats.search_ms + stats.merge_ms << " ms" << std::endl;
+
+    out << "max tile:" << std::endl;
+    for (int rank = 1; rank < SQUARE_N; ++rank) {
+        if (tiles[rank])
+            out << std::setw(8) << bits_to_value(rank) << std::setw(8) << tiles[rank]
+                << std::setw(8) << std::fixed << std::setprecision(1) << 100.0 * tiles[rank] / n << "%"
+                << std::defaultfloat << std::endl;
+    }
+}
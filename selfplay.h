@@ -0,0 +1,39 @@
+#ifndef SELFPLAY_H_INCLUDED
+#define SELFPLAY_H_INCLUDED
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "types.h"
+#include "search.h"
+
+namespace SelfPlay {
+
+    struct Options {
+        int games = 100;
+        uint64_t seed = 1;      // game i is played from seed + i
+        int threads = 0;        // 0 for all
+        size_t tt_mb = 16;      // transposition table size per thread
+        std::string log;        // write every game to this binary game log, see gamelog.h
+    };
+
+    struct GameRecord {
+        uint64_t seed;
+        Bitboard board;         // final position
+        int moves;
+        int score;
+        std::vector<float> move_ms;
+        Search::Stats stats;    // summed over all moves
+    };
+
+    struct Batch {
+        std::vector<GameRecord> games;
+        double seconds;         // wall time of the whole batch
+    };
+
+    Batch run(const Options &options);
+    void report(const Batch &batch, std::ostream &out);
+}
+
+#endif
@@ -0,0 +1,329 @@
+#include "server.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <list>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <csignal>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "bitboard.h"
+#include "search.h"
+#include "tt.h"
+#include "omp.h"
+
+using namespace Server;
+
+
+bool write_all(int fd, const std::string &s) {
+    size_t done = 0;
+
+    while (done < s.size()) {
+        ssize_t n = write(fd, s.data() + done, s.size() - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        done += n;
+    }
+
+    return true;
+}
+
+
+/*
+    The requests of one client. Answers are kept until all earlier ones
+    have been written, so that they go out in the order of the requests.
+    Once a write fails the client is gone, and its remaining answers are
+    dropped.
+*/
+class Session {
+public:
+    Session(int in, int out): in(in), out(out) {}
+
+    int in, out;
+
+    // Number the next request
+    uint64_t next_request() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return requests++;
+    }
+
+    void answer(uint64_t seq, const std::string &line) {
+        std::lock_guard<std::mutex> lock(mutex);
+        done[seq] = line;
+
+        std::string ready;
+        for (auto it = done.begin(); it != done.end() && it->first == written; it = done.erase(it)) {
+            ready += it->second;
+            ++written;
+        }
+
+        if (!ready.empty() && !gone && !write_all(out, ready))
+            gone = true;
+
+        if (written == requests)
+            idle.notify_all();
+    }
+
+    // Whether a write to the client failed
+    bool closed() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return gone;
+    }
+
+    // Wait for every request made so far to be answered
+    void drain() {
+        std::unique_lock<std::mutex> lock(mutex);
+        idle.wait(lock, [&] { return written == requests; });
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable idle;
+    std::map<uint64_t, std::string> done;
+    uint64_t requests = 0;
+    uint64_t written = 0;
+    bool gone = false;
+};
+
+
+struct Job {
+    Session *session;
+    uint64_t seq;
+    Bitboard board;
+};
+
+
+class Pool {
+public:
+    Pool(const Options &options) {
+        for (int i = 0; i < options.workers; ++i)
+            workers.emplace_back([this, &options] { work(options.tt_mb); });
+    }
+
+    ~Pool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closing = true;
+        }
+        ready.notify_all();
+
+        for (std::thread &t: workers)
+            t.join();
+    }
+
+    void push(const Job &job) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(job);
+        }
+        ready.notify_one();
+    }
+
+private:
+    void work(size_t tt_mb) {
+        TranspositionTable tt;
+        tt.resize(tt_mb);
+        Search::set_table(&tt);
+
+        while (true) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                ready.wait(lock, [&] { return closing || !jobs.empty(); });
+
+                if (jobs.empty())
+                    break;
+
+                job = jobs.front();
+                jobs.pop_front();
+            }
+
+            // Nobody reads the answer, but it still has to be counted
+            if (job.session->closed()) {
+                job.session->answer(job.seq, "");
+                continue;
+            }
+
+            Search::Result r = Search::expectimax_parallel(job.board);
+
+            std::stringstream ss;
+            ss << std::hex << std::setw(16) << std::setfill('0') << job.board << std::dec << " "
+               << (r.move == NULL_MOVE ? "None" : Bitboards::pretty(r.move)) << " " << r.value << "\n";
+            job.session->answer(job.seq, ss.str());
+        }
+
+        Search::set_table(&TT);
+    }
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<Job> jobs;
+    bool closing = false;
+};
+
+
+bool parse_board(const std::string &line, Bitboard &board) {
+    if (line.empty() || line.size() > 16)
+        return false;
+
+    for (char c: line)
+        if (!isxdigit((unsigned char) c))
+            return false;
+
+    board = std::stoull(line, nullptr, 16);
+    return true;
+}
+
+
+/*
+    Read the requests of a client until it closes its end, then wait
+    for the answers to all of them.
+*/
+void serve(Session &session, Pool &pool) {
+    std::string buffer, line;
+    char chunk[4096];
+
+    while (true) {
+        size_t eol;
+        while ((eol = buffer.find('\n')) != std::string::npos) {
+            line = buffer.substr(0, eol);
+            buffer.erase(0, eol + 1);
+
+            if (!line.empty() && line.back() == '\r')
+                line.pop_back();
+            if (line.empty())
+                continue;
+
+            Bitboard board;
+            uint64_t seq = session.next_request();
+
+            if (parse_board(line, board))
+                pool.push({&session, seq, board});
+            else
+                session.answer(seq, "error " + line + "\n");
+        }
+
+        ssize_t n = read(session.in, chunk, sizeof(chunk));
+        if (n <= 0)
+            break;
+        buffer.append(chunk, n);
+    }
+
+    session.drain();
+}
+
+
+int listen_unix(const std::string &path) {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+
+    if (path.size() >= sizeof(addr.sun_path)) {
+        std::cerr << "Socket path too long: " << path << std::endl;
+        return -1;
+    }
+    std::strcpy(addr.sun_path, path.c_str());
+
+    // Replace the socket of an earlier server, but no other kind of file
+    struct stat st;
+    if (lstat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+        unlink(path.c_str());
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (fd < 0 || bind(fd, (sockaddr*) &addr, sizeof(addr)) < 0 || listen(fd, 16) < 0) {
+        std::cerr << "Could not listen on " << path << ": " << std::strerror(errno) << std::endl;
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+
+// A client thread, and whether it is done and can be joined
+struct Client {
+    std::thread thread;
+    std::atomic<bool> done{false};
+};
+
+
+/*
+    Serve stdin until it is closed, or accept clients on the socket until
+    the process is killed, each client on its own thread. A client that
+    goes away fails the writes to it instead of raising SIGPIPE.
+*/
+int Server::run(const Options &options) {
+    signal(SIGPIPE, SIG_IGN);
+
+    int workers = std::max(1, options.workers);
+    Search::config.threads = options.threads ? options.threads
+                                             : std::max(1, omp_get_num_procs() / workers);
+
+    Options pool_options = options;
+    pool_options.workers = workers;
+    Pool pool(pool_options);
+
+    if (options.socket.empty()) {
+        Session session(STDIN_FILENO, STDOUT_FILENO);
+        serve(session, pool);
+        return 0;
+    }
+
+    int fd = listen_unix(options.socket);
+    if (fd < 0)
+        return 1;
+
+    // The client threads use the pool, so they are all joined before it goes
+    std::list<Client> clients;
+
+    while (true) {
+        int client = accept(fd, nullptr, nullptr);
+        if (client < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        for (auto it = clients.begin(); it != clients.end(); ) {
+            if (it->done) {
+                it->thread.join();
+                it = clients.erase(it);
+            }
+            else
+                ++it;
+        }
+
+        clients.emplace_back();
+        Client &c = clients.back();
+        c.thread = std::thread([client, &pool, &c] {
+            Session session(client, client);
+            serve(session, pool);
+            close(client);
+            c.done = true;
+        });
+    }
+
+    for (Client &c: clients)
+        c.thread.join();
+
+    close(fd);
+    unlink(options.socket.c_str());
+    return 1;
+}
@@ -0,0 +1,32 @@
+#ifndef SERVER_H_INCLUDED
+#define SERVER_H_INCLUDED
+
+#include <string>
+
+/*
+    Long running search server. Every request is a line holding a board as
+    16 hex digits, and is answered by a line with the board, the best move
+    and its value from expectimax_parallel:
+
+        0000000000030122
+        0000000000030122 Right 8.42121
+
+    Clients may send any number of requests without waiting for answers.
+    The requests are searched by a pool of workers, each with its own
+    transposition table, and the answers of a client come back in the
+    order of its requests. A line that is not a board is answered with
+    "error" and the line.
+*/
+namespace Server {
+
+    struct Options {
+        std::string socket;     // Unix domain socket to listen on, stdin and stdout if empty
+        int workers = 1;        // searches running at once
+        int threads = 0;        // threads per search, 0 for the processors shared out over the workers
+        size_t tt_mb = 64;      // transposition table size per worker
+    };
+
+    int run(const Options &options);
+}
+
+#endif
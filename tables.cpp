@@ -0,0 +1,145 @@
+#include "tables.h"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bitboard.h"
+#include "search.h"
+#include "eval.h"
+
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t size;          // bytes following the header
+    uint64_t fingerprint;   // Eval::fingerprint() of the weights the values were computed with
+    uint64_t checksum;      // of everything following the header
+};
+
+const char MAGIC[8] = "2048TBL";
+
+struct Section {
+    void *data;
+    size_t size;
+};
+
+const Section Sections[] = {
+    {RowMoveLeft, sizeof(RowMoveLeft)},
+    {RowMoveRight, sizeof(RowMoveRight)},
+    {RowReverse, sizeof(RowReverse)},
+    {Eval::RowValue, sizeof(Eval::RowValue)},
+    {Eval::ColValue, sizeof(Eval::ColValue)}
+};
+
+
+uint32_t payload_size() {
+    uint32_t size = 0;
+    for (const Section &s: Sections)
+        size += s.size;
+    return size;
+}
+
+
+// FNV-1a over 64 bit words, all section sizes are multiples of 8
+uint64_t checksum(const uint64_t *words, size_t n, uint64_t hash = 0xcbf29ce484222325ULL) {
+    for (size_t i = 0; i < n; ++i)
+        hash = (hash ^ words[i]) * 0x100000001b3ULL;
+    return hash;
+}
+
+
+/*
+    Use the tables in path if it holds a valid file, otherwise compute them
+    and write them to path for the next process. A null path always computes.
+*/
+void Tables::init(const char *path) {
+    bool loaded = path && load(path);
+
+    Bitboards::init(!loaded);
+    Search::init(!loaded);
+
+    if (path && !loaded)
+        save(path);
+}
+
+
+bool Tables::load(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    size_t expected = sizeof(Header) + payload_size();
+
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size != expected) {
+        close(fd);
+        return false;
+    }
+
+    void *map = mmap(nullptr, expected, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (map == MAP_FAILED)
+        return false;
+
+    const Header *header = (const Header*) map;
+    const char *payload = (const char*) map + sizeof(Header);
+
+    bool valid = std::memcmp(header->magic, MAGIC, sizeof(MAGIC)) == 0
+              && header->version == VERSION
+              && header->size == payload_size()
+              && header->fingerprint == Eval::fingerprint()
+              && header->checksum == checksum((const uint64_t*) payload, header->size / 8);
+
+    if (valid) {
+        for (const Section &s: Sections) {
+            std::memcpy(s.data, payload, s.size);
+            payload += s.size;
+        }
+    }
+
+    munmap(map, expected);
+    return valid;
+}
+
+
+/*
+    Write to a temporary file and rename it into place, so that processes
+    starting at the same time never see a half written file.
+*/
+bool Tables::save(const char *path) {
+    Header header = {};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.size = payload_size();
+    header.fingerprint = Eval::fingerprint();
+
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (const Section &s: Sections)
+        hash = checksum((const uint64_t*) s.data, s.size / 8, hash);
+    header.checksum = hash;
+
+    std::string tmp = std::string(path) + "." + std::to_string(getpid());
+    FILE *f = fopen(tmp.c_str(), "wb");
+    if (!f)
+        return false;
+
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+    for (const Section &s: Sections)
+        ok = ok && fwrite(s.data, s.size, 1, f) == 1;
+
+    ok = (fclose(f) == 0) && ok;
+
+    if (!ok || rename(tmp.c_str(), path) != 0) {
+        remove(tmp.c_str());
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,20 @@
+#ifndef TABLES_H_INCLUDED
+#define TABLES_H_INCLUDED
+
+/*
+    Binary cache of the row lookup tables, so that short lived processes
+    can map them from disk instead of computing them at startup.
+
+    File layout: a Header followed by RowMoveLeft, RowMoveRight, RowReverse,
+    Eval::RowValue and Eval::ColValue, exactly as they are laid out in memory.
+*/
+namespace Tables {
+
+    const unsigned int VERSION = 2;    // bump whenever the table contents change
+
+    void init(const char *path);
+    bool load(const char *path);
+    bool save(const char *path);
+}
+
+#endif
@@ -0,0 +1,146 @@
+#include "tt.h"
+
+#include <cstring>
+#include <iostream>
+
+TranspositionTable TT;
+
+
+inline uint64_t pack(double value, int depth, uint8_t generation, bool upper) {
+    float v = (float) value;
+    uint32_t bits;
+    std::memcpy(&bits, &v, sizeof(bits));
+
+    return bits | (uint64_t) depth << 32 | (uint64_t) generation << 40 | (uint64_t) upper << 48;
+}
+
+inline double unpack_value(uint64_t data) {
+    uint32_t bits = (uint32_t) data;
+    float v;
+    std::memcpy(&v, &bits, sizeof(v));
+
+    return v;
+}
+
+inline int unpack_depth(uint64_t data) { return (data >> 32) & 0xFF; }
+inline uint8_t unpack_generation(uint64_t data) { return (data >> 40) & 0xFF; }
+inline bool unpack_upper(uint64_t data) { return (data >> 48) & 1; }
+
+
+/*
+    Allocate a table of at most mb megabytes. The number of clusters
+    is rounded down to a power of two so the index is a single shift.
+*/
+void TranspositionTable::resize(size_t mb) {
+    size_t count = 1;
+    while (count * 2 * sizeof(Cluster) <= (mb << 20))
+        count *= 2;
+
+    if (count == cluster_count)
+        return;
+
+    free(mem);
+    mem = malloc(count * sizeof(Cluster) + 63);
+
+    if (!mem) {
+        std::cerr << "Failed to allocate " << mb << "MB for transposition table." << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    table = (Cluster*)(((uintptr_t)mem + 63) & ~(uintptr_t)63);  // align to cache line
+    cluster_count = count;
+
+    shift = 64;
+    for (size_t c = count; c > 1; c >>= 1)
+        --shift;
+
+    clear();
+}
+
+
+void TranspositionTable::clear() {
+    if (table)
+        std::memset((void*)table, 0, cluster_count * sizeof(Cluster));
+}
+
+
+/*
+    Look up the exact value of a board searched to at least the given
+    remaining depth. Entries searched deeper than asked for are also accepted.
+*/
+bool TranspositionTable::probe(Bitboard b, int depth, double &value) {
+    bool upper;
+    return probe(b, depth, value, upper) && !upper;
+}
+
+
+// As above, but also returns upper bounds stored by a bounded search
+bool TranspositionTable::probe(Bitboard b, int depth, double &value, bool &upper) {
+    if (!table)
+        return false;
+
+    TTEntry *tte = first_entry(b)->entry;
+
+    for (int i = 0; i < ClusterSize; ++i) {
+        uint64_t data = tte[i].data.load(std::memory_order_relaxed);
+        uint64_t key = tte[i].key.load(std::memory_order_relaxed);
+
+        if ((key ^ data) == b && data) {
+            if (unpack_depth(data) < depth)
+                break;
+
+            value = unpack_value(data);
+            upper = unpack_upper(data);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+/*
+    Store a search result. An existing entry for the same board is overwritten,
+    otherwise we replace the entry with the lowest depth, treating entries from
+    older searches as shallower the older they are. An upper bound does not
+    replace an exact value of the same board searched at least as deep.
+    Returns true if an entry for another board had to be evicted. A table
+    that has not been resized yet stores nothing.
+*/
+bool TranspositionTable::store(Bitboard b, int depth, double value, bool upper) {
+    if (!table)
+        return false;
+
+    TTEntry *tte = first_entry(b)->entry;
+    TTEntry *replace = tte;
+    int worst = INT32_MAX;
+    bool full = true;
+
+    for (int i = 0; i < ClusterSize; ++i) {
+        uint64_t data = tte[i].data.load(std::memory_order_relaxed);
+        uint64_t key = tte[i].key.load(std::memory_order_relaxed);
+
+        if (!data || (key ^ data) == b) {
+            if (data && upper && !unpack_upper(data) && unpack_depth(data) >= depth)
+                return false;
+
+            replace = &tte[i];
+            full = false;
+            break;
+        }
+
+        int age = (uint8_t)(generation.load(std::memory_order_relaxed) - unpack_generation(data));
+        int worth = unpack_depth(data) - 2 * age;
+
+        if (worth < worst) {
+            worst = worth;
+            replace = &tte[i];
+        }
+    }
+
+    uint64_t data = pack(value, depth, generation.load(std::memory_order_relaxed), upper);
+    replace->key.store(b ^ data, std::memory_order_relaxed);
+    replace->data.store(data, std::memory_order_relaxed);
+
+    return full;
+}
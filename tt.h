@@ -0,0 +1,66 @@
+#ifndef TT_H_INCLUDED
+#define TT_H_INCLUDED
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+
+#include "types.h"
+
+
+/*
+    Transposition table shared by all search threads.
+
+    The table is an array of clusters, each one cache line wide and holding
+    four entries. Entries are written without locks: the key word stores the
+    board xor'ed with the data word, so an entry torn by two threads writing
+    at once no longer matches any board and simply reads as a miss.
+
+    Data word layout:
+        bits  0-31  value (float)
+        bits 32-39  remaining depth
+        bits 40-47  generation
+        bit  48     value is only an upper bound (bounded search)
+*/
+struct TTEntry {
+    std::atomic<uint64_t> key;
+    std::atomic<uint64_t> data;
+};
+
+
+class TranspositionTable {
+
+    static const int ClusterSize = 4;
+
+    struct Cluster {
+        TTEntry entry[ClusterSize];
+    };
+
+public:
+    ~TranspositionTable() { free(mem); }
+
+    void resize(size_t mb);
+    void clear();
+    void new_search() { ++generation; }
+
+    bool probe(Bitboard b, int depth, double &value);
+    bool probe(Bitboard b, int depth, double &value, bool &upper);
+    bool store(Bitboard b, int depth, double value, bool upper = false);
+
+    size_t size_mb() const { return cluster_count * sizeof(Cluster) >> 20; }
+
+private:
+    Cluster *first_entry(Bitboard b) const {
+        return table + ((b * 0x9E3779B97F4A7C15ULL) >> shift);
+    }
+
+    size_t cluster_count = 0;
+    int shift = 64;
+    Cluster *table = nullptr;
+    void *mem = nullptr;
+    std::atomic<uint8_t> generation{0};
+};
+
+extern TranspositionTable TT;
+
+#endif
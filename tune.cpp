@@ -0,0 +1,216 @@
+#include "tune.h"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include "bitboard.h"
+#include "search.h"
+#include "selfplay.h"
+
+using namespace Tune;
+
+const int PARAMS = SQUARE_N + 5;
+
+// First step tried for every weight, halved after a pass without improvement
+const double InitialStep[PARAMS] = {
+    0.1, 0.1, 0.1, 0.1,
+    0.1, 0.1, 0.1, 0.1,
+    0.1, 0.1, 0.1, 0.1,
+    0.1, 0.1, 0.1, 0.1,
+    0.01,       // empty_factor
+    0.1,        // monotonicity
+    50,         // smoothness
+    100,        // merges
+    100         // empty
+};
+
+
+struct State {
+    int pass;
+    int param;              // next weight to try in this pass
+    bool improved;          // whether this pass has found a better candidate yet
+    double objective;
+    std::vector<double> params;
+    std::vector<double> steps;
+};
+
+
+std::vector<double> to_params(const Eval::Weights &w) {
+    std::vector<double> p(w.gradient, w.gradient + SQUARE_N);
+    p.insert(p.end(), {w.empty_factor, w.monotonicity, w.smoothness, w.merges, w.empty});
+    return p;
+}
+
+
+Eval::Weights from_params(const std::vector<double> &p) {
+    Eval::Weights w;
+    std::copy(p.begin(), p.begin() + SQUARE_N, w.gradient);
+    w.empty_factor = p[SQUARE_N];
+    w.monotonicity = p[SQUARE_N + 1];
+    w.smoothness = p[SQUARE_N + 2];
+    w.merges = p[SQUARE_N + 3];
+    w.empty = p[SQUARE_N + 4];
+    return w;
+}
+
+
+std::string param_name(int i) {
+    const char *names[] = {"empty_factor", "monotonicity", "smoothness", "merges", "empty"};
+    return i < SQUARE_N ? "gradient[" + std::to_string(i) + "]" : names[i - SQUARE_N];
+}
+
+
+// Play the candidate's games, always from the same seeds so candidates see the same tiles
+double objective(const std::vector<double> &params, const Options &options) {
+    Eval::init(from_params(params));
+
+    SelfPlay::Options play;
+    play.games = options.games;
+    play.seed = 1;
+
+    SelfPlay::Batch batch = SelfPlay::run(play);
+
+    double total = 0;
+    for (const SelfPlay::GameRecord &g: batch.games) {
+        switch (options.objective) {
+            case MEAN_SCORE:
+                total += g.score;
+                break;
+            case REACH_2048:
+                total += max_value(g.board) >= 2048;
+                break;
+            case REACH_4096:
+                total += max_value(g.board) >= 4096;
+                break;
+        }
+    }
+
+    return total / batch.games.size();
+}
+
+
+void save(const std::string &path, const State &st) {
+    std::ofstream out(path);
+    out.precision(17);
+
+    out << "pass " << st.pass << std::endl;
+    out << "param " << st.param << std::endl;
+    out << "improved " << st.improved << std::endl;
+    out << "objective " << st.objective << std::endl;
+
+    out << "weights";
+    for (double p: st.params) out << " " << p;
+    out << std::endl;
+
+    out << "steps";
+    for (double s: st.steps) out << " " << s;
+    out << std::endl;
+}
+
+
+bool load_state(const std::string &path, State &st) {
+    std::ifstream in(path);
+    std::string line;
+    int found = 0;
+
+    while (std::getline(in, line)) {
+        std::istringstream ss(line);
+        std::string key;
+        ss >> key;
+
+        std::vector<double> *values = key == "weights" ? &st.params : key == "steps" ? &st.steps : nullptr;
+
+        if (values) {
+            values->clear();
+            for (double v; ss >> v; )
+                values->push_back(v);
+            found += values->size() == PARAMS;
+        }
+        else if (key == "pass") found += bool(ss >> st.pass);
+        else if (key == "param") found += bool(ss >> st.param);
+        else if (key == "improved") found += bool(ss >> st.improved);
+        else if (key == "objective") found += bool(ss >> st.objective);
+    }
+
+    return found == 6;
+}
+
+
+// Weights saved in a tuning checkpoint
+bool Tune::load(const std::string &path, Eval::Weights &weights) {
+    State st;
+    if (!load_state(path, st))
+        return false;
+
+    weights = from_params(st.params);
+    return true;
+}
+
+
+/*
+    Try every weight one step up and one step down, keeping the first
+    change that improves the objective. When a whole pass finds nothing
+    better all steps are halved.
+*/
+Eval::Weights Tune::run(const Options &options) {
+    int depth = Search::config.depth;
+    Search::DepthPolicy policy = Search::config.depth_policy;
+
+    Search::config.depth = options.depth;
+    Search::config.depth_policy = Search::fixed_depth;
+
+    State st;
+    if (load_state(options.checkpoint, st)) {
+        std::cout << "resuming from " << options.checkpoint << " at pass " << st.pass
+                  << ", objective " << st.objective << std::endl;
+    }
+    else {
+        st = {0, 0, false, 0, to_params(Eval::weights), std::vector<double>(InitialStep, InitialStep + PARAMS)};
+        st.objective = objective(st.params, options);
+        save(options.checkpoint, st);
+        std::cout << "initial objective " << st.objective << std::endl;
+    }
+
+    for (; st.pass < options.passes; ++st.pass) {
+        for (; st.param < PARAMS; ++st.param) {
+            int i = st.param;
+
+            for (int dir = 1; dir >= -1; dir -= 2) {
+                std::vector<double> candidate = st.params;
+                candidate[i] += dir * st.steps[i];
+
+                double value = objective(candidate, options);
+
+                std::cout << "pass " << st.pass << " " << param_name(i) << " " << candidate[i]
+                          << ": " << value << " (best " << st.objective << ")" << std::endl;
+
+                if (value > st.objective) {
+                    st.params = candidate;
+                    st.objective = value;
+                    st.improved = true;
+                    break;
+                }
+            }
+
+            save(options.checkpoint, {st.pass, i + 1, st.improved, st.objective, st.params, st.steps});
+        }
+
+        if (!st.improved) {
+            for (double &s: st.steps)
+                s /= 2;
+        }
+
+        st.param = 0;
+        st.improved = false;
+        save(options.checkpoint, {st.pass + 1, 0, false, st.objective, st.params, st.steps});
+    }
+
+    Search::config.depth = depth;
+    Search::config.depth_policy = policy;
+
+    Eval::Weights best = from_params(st.params);
+    Eval::init(best);
+    return best;
+}
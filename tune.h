@@ -0,0 +1,35 @@
+#ifndef TUNE_H_INCLUDED
+#define TUNE_H_INCLUDED
+
+#include <string>
+
+#include "eval.h"
+
+/*
+    Coordinate descent over the evaluation weights. Every candidate is
+    scored by a batch of shallow self-play games, always from the same
+    seeds, and progress is written to a checkpoint after every candidate
+    so that a run can be stopped and resumed.
+*/
+namespace Tune {
+
+    enum Objective {
+        MEAN_SCORE,
+        REACH_2048,
+        REACH_4096
+    };
+
+    struct Options {
+        int games = 200;            // games per candidate
+        int depth = 2;              // search depth of the games
+        int passes = 10;            // passes over all weights
+        Objective objective = MEAN_SCORE;
+        std::string checkpoint = "tune.txt";
+    };
+
+    Eval::Weights run(const Options &options);
+
+    bool load(const std::string &path, Eval::Weights &weights);
+}
+
+#endif